@@ -56,8 +56,20 @@ SOURCES += main.cpp \
     upnp/upnprenderermodel.cpp \
     upnp/browsemodelstack.cpp \
     networkcontrol.cpp \
+    thumbnailprovider.cpp \
     upnp/browsemodel_p.cpp \
     upnp/browsemodel.cpp \
+    upnp/browsecache.cpp \
+    upnp/browsecrawler.cpp \
+    upnp/browsefilter.cpp \
+    upnp/protocolinfomatcher.cpp \
+    upnp/browseresultparser.cpp \
+    upnp/browsescheduler.cpp \
+    upnp/browserowstore.cpp \
+    upnp/browseslicesizer.cpp \
+    upnp/browsesorter.cpp \
+    upnp/playbackclock.cpp \
+    upnp/playbackqueue.cpp \
     upnp/logger.cpp
 
 # Please do not modify the following two lines. Required for deployment.
@@ -85,9 +97,21 @@ HEADERS += \
     upnp/upnprenderermodel.h \
     upnp/browsemodelstack.h \
     networkcontrol.h \
+    thumbnailprovider.h \
     settings.h \
     upnp/browsemodel_p.h \
     upnp/browsemodel.h \
+    upnp/browsecache.h \
+    upnp/browsecrawler.h \
+    upnp/browsefilter.h \
+    upnp/protocolinfomatcher.h \
+    upnp/browseresultparser.h \
+    upnp/browsescheduler.h \
+    upnp/browserowstore.h \
+    upnp/browseslicesizer.h \
+    upnp/browsesorter.h \
+    upnp/playbackclock.h \
+    upnp/playbackqueue.h \
     version.h.in \
     upnp/logger.h \
     upnp/logger_p.h
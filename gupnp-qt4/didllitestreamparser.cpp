@@ -0,0 +1,455 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <libxml/parser.h>
+
+#include <QtCore/QByteArray>
+
+#include "didllitestreamparser.h"
+
+const int ARENA_BLOCK_SIZE = 16 * 1024;
+
+DIDLLiteArena::DIDLLiteArena()
+    : m_blocks()
+    , m_used(ARENA_BLOCK_SIZE)
+    , m_size(0)
+{
+}
+
+DIDLLiteArena::~DIDLLiteArena()
+{
+    clear();
+}
+
+/*!
+ * \brief Copy a string into the arena.
+ * \param string the string to copy, need not be 0-terminated
+ * \param length number of bytes to copy
+ * \return the 0-terminated copy.
+ */
+const char *DIDLLiteArena::add(const char *string, int length)
+{
+    char *copy;
+
+    if (length + 1 > ARENA_BLOCK_SIZE - m_used) {
+        // Long strings get a block of their own, the current one is still
+        // usable for the following strings
+        if (length + 1 > ARENA_BLOCK_SIZE / 4) {
+            copy = static_cast<char *>(malloc(length + 1));
+            m_blocks.prepend(copy);
+            m_size += length + 1;
+            memcpy(copy, string, length);
+            copy[length] = '\0';
+
+            return copy;
+        }
+
+        m_blocks.append(static_cast<char *>(malloc(ARENA_BLOCK_SIZE)));
+        m_size += ARENA_BLOCK_SIZE;
+        m_used = 0;
+    }
+
+    copy = m_blocks.last() + m_used;
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+    m_used += length + 1;
+
+    return copy;
+}
+
+void DIDLLiteArena::clear()
+{
+    Q_FOREACH(char *block, m_blocks) {
+        free(block);
+    }
+    m_blocks.clear();
+    m_used = ARENA_BLOCK_SIZE;
+    m_size = 0;
+}
+
+/*!
+ * \brief Get the number of bytes allocated by the arena.
+ */
+int DIDLLiteArena::size() const
+{
+    return m_size;
+}
+
+class DIDLLiteStreamParserPrivate
+{
+public:
+    enum Property {
+        PropertyNone,
+        PropertyTitle,
+        PropertyClass,
+        PropertyArtist,
+        PropertyAlbum,
+        PropertyAlbumArt,
+        PropertyTrackNumber,
+        PropertyResource
+    };
+
+    DIDLLiteStreamParserPrivate();
+
+    static void onStartElement(void *user_data,
+                               const xmlChar *localname,
+                               const xmlChar *prefix,
+                               const xmlChar *uri,
+                               int nb_namespaces,
+                               const xmlChar **namespaces,
+                               int nb_attributes,
+                               int nb_defaulted,
+                               const xmlChar **attributes);
+    static void onEndElement(void *user_data,
+                             const xmlChar *localname,
+                             const xmlChar *prefix,
+                             const xmlChar *uri);
+    static void onCharacters(void *user_data, const xmlChar *ch, int len);
+
+    const char *attribute(const xmlChar **attributes, int count, const char *name);
+
+    DIDLLiteArena m_arena;
+    QVector<DIDLLiteRecord> m_records;
+    QVector<DIDLLiteResourceRecord> m_resources;
+    QString m_lastError;
+
+    int m_depth;
+    bool m_inObject;
+    Property m_property;
+    QByteArray m_text;
+    DIDLLiteRecord m_record;
+    DIDLLiteResourceRecord m_resource;
+};
+
+DIDLLiteStreamParserPrivate::DIDLLiteStreamParserPrivate()
+    : m_arena()
+    , m_records()
+    , m_resources()
+    , m_lastError()
+    , m_depth(0)
+    , m_inObject(false)
+    , m_property(PropertyNone)
+    , m_text()
+{
+}
+
+/*!
+ * \brief Look up an attribute of a SAX2 start element and copy it to the arena.
+ *
+ * Without XML_PARSE_NOENT, libxml2 hands out &amp; in attribute values as
+ * &#38;, the other predefined entities are unescaped already.
+ *
+ * \return the value of the attribute or 0 if the element does not have it.
+ */
+const char *DIDLLiteStreamParserPrivate::attribute(const xmlChar **attributes, int count, const char *name)
+{
+    for (int i = 0; i < count * 5; i += 5) {
+        if (strcmp((const char *) attributes[i], name) == 0) {
+            const char *value = (const char *) attributes[i + 3];
+            const int length = attributes[i + 4] - attributes[i + 3];
+
+            if (memchr(value, '&', length) == 0) {
+                return m_arena.add(value, length);
+            }
+
+            const QByteArray unescaped = QByteArray(value, length).replace("&#38;", "&");
+
+            return m_arena.add(unescaped.constData(), unescaped.size());
+        }
+    }
+
+    return 0;
+}
+
+static long parseDuration(const char *duration)
+{
+    long hours = 0, minutes = 0, seconds = 0;
+
+    if (duration == 0 || sscanf(duration, "%ld:%ld:%ld", &hours, &minutes, &seconds) != 3) {
+        return -1;
+    }
+
+    return hours * 3600 + minutes * 60 + seconds;
+}
+
+void DIDLLiteStreamParserPrivate::onStartElement(void *user_data,
+                                                 const xmlChar *localname,
+                                                 const xmlChar *prefix,
+                                                 const xmlChar *uri,
+                                                 int nb_namespaces,
+                                                 const xmlChar **namespaces,
+                                                 int nb_attributes,
+                                                 int nb_defaulted,
+                                                 const xmlChar **attributes)
+{
+    Q_UNUSED(prefix);
+    Q_UNUSED(uri);
+    Q_UNUSED(nb_namespaces);
+    Q_UNUSED(namespaces);
+    Q_UNUSED(nb_defaulted);
+
+    auto self = static_cast<DIDLLiteStreamParserPrivate *>(user_data);
+    auto name = (const char *) localname;
+
+    self->m_depth++;
+
+    // <DIDL-Lite><item|container><property/></item|container></DIDL-Lite>
+    if (self->m_depth == 2) {
+        self->m_inObject = strcmp(name, "item") == 0 || strcmp(name, "container") == 0;
+        if (not self->m_inObject) {
+            return;
+        }
+
+        memset(&self->m_record, 0, sizeof(DIDLLiteRecord));
+        self->m_record.container = name[0] == 'c';
+        self->m_record.id = self->attribute(attributes, nb_attributes, "id");
+        self->m_record.parentId = self->attribute(attributes, nb_attributes, "parentID");
+        const char *restricted = self->attribute(attributes, nb_attributes, "restricted");
+        self->m_record.restricted = restricted != 0 &&
+                                    (strcmp(restricted, "1") == 0 || strcmp(restricted, "true") == 0);
+        self->m_record.originalTrackNumber = -1;
+        self->m_record.firstResource = self->m_resources.count();
+
+        return;
+    }
+
+    if (self->m_depth != 3 || not self->m_inObject) {
+        return;
+    }
+
+    self->m_property = PropertyNone;
+    if (strcmp(name, "title") == 0 && self->m_record.title == 0) {
+        self->m_property = PropertyTitle;
+    } else if (strcmp(name, "class") == 0 && self->m_record.upnpClass == 0) {
+        self->m_property = PropertyClass;
+    } else if (strcmp(name, "artist") == 0 && self->m_record.artist == 0) {
+        self->m_property = PropertyArtist;
+    } else if (strcmp(name, "album") == 0 && self->m_record.album == 0) {
+        self->m_property = PropertyAlbum;
+    } else if (strcmp(name, "albumArtURI") == 0 && self->m_record.albumArtUri == 0) {
+        self->m_property = PropertyAlbumArt;
+    } else if (strcmp(name, "originalTrackNumber") == 0 && self->m_record.originalTrackNumber < 0) {
+        self->m_property = PropertyTrackNumber;
+    } else if (strcmp(name, "res") == 0) {
+        self->m_property = PropertyResource;
+
+        DIDLLiteResourceRecord &res = self->m_resource;
+        res.uri = 0;
+        res.protocolInfo = self->attribute(attributes, nb_attributes, "protocolInfo");
+
+        const char *size = self->attribute(attributes, nb_attributes, "size");
+        res.size = size != 0 ? g_ascii_strtoll(size, 0, 10) : -1;
+        res.duration = parseDuration(self->attribute(attributes, nb_attributes, "duration"));
+
+        const char *resolution = self->attribute(attributes, nb_attributes, "resolution");
+        if (resolution == 0 || sscanf(resolution, "%dx%d", &res.width, &res.height) != 2) {
+            res.width = res.height = -1;
+        }
+    }
+
+    self->m_text.clear();
+}
+
+void DIDLLiteStreamParserPrivate::onEndElement(void *user_data,
+                                               const xmlChar *localname,
+                                               const xmlChar *prefix,
+                                               const xmlChar *uri)
+{
+    Q_UNUSED(localname);
+    Q_UNUSED(prefix);
+    Q_UNUSED(uri);
+
+    auto self = static_cast<DIDLLiteStreamParserPrivate *>(user_data);
+
+    if (self->m_depth == 3 && self->m_property != PropertyNone) {
+        const char *text = self->m_arena.add(self->m_text.constData(), self->m_text.size());
+
+        switch (self->m_property) {
+        case PropertyTitle:
+            self->m_record.title = text;
+            break;
+        case PropertyClass:
+            self->m_record.upnpClass = text;
+            break;
+        case PropertyArtist:
+            self->m_record.artist = text;
+            break;
+        case PropertyAlbum:
+            self->m_record.album = text;
+            break;
+        case PropertyAlbumArt:
+            self->m_record.albumArtUri = text;
+            break;
+        case PropertyTrackNumber:
+            self->m_record.originalTrackNumber = atoi(text);
+            break;
+        case PropertyResource:
+            self->m_resource.uri = text;
+            self->m_resources << self->m_resource;
+            self->m_record.resourceCount++;
+            break;
+        default:
+            break;
+        }
+        self->m_property = PropertyNone;
+    } else if (self->m_depth == 2 && self->m_inObject) {
+        // Objects without id are invalid, same as in GUPnPDIDLLiteParser
+        if (self->m_record.id != 0) {
+            self->m_records << self->m_record;
+        } else {
+            self->m_resources.resize(self->m_record.firstResource);
+        }
+        self->m_inObject = false;
+    }
+
+    self->m_depth--;
+}
+
+void DIDLLiteStreamParserPrivate::onCharacters(void *user_data, const xmlChar *ch, int len)
+{
+    auto self = static_cast<DIDLLiteStreamParserPrivate *>(user_data);
+
+    if (self->m_property != PropertyNone) {
+        self->m_text.append((const char *) ch, len);
+    }
+}
+
+DIDLLiteStreamParser::DIDLLiteStreamParser()
+    : d_ptr(new DIDLLiteStreamParserPrivate)
+{
+}
+
+DIDLLiteStreamParser::~DIDLLiteStreamParser()
+{
+    delete d_ptr;
+}
+
+/*!
+ * \brief Parse a DIDL-Lite XML snippet into DIDLLiteRecords.
+ *
+ * Results of a previous parse() are discarded.
+ *
+ * \param didlLite the UTF-8 encoded DIDL-Lite XML snippet to parse
+ * \param length length of didlLite in bytes
+ * \return true on success, false otherwise.
+ * \sa records(), resources(), errorMessage()
+ */
+bool DIDLLiteStreamParser::parse(const char *didlLite, int length)
+{
+    Q_D(DIDLLiteStreamParser);
+    xmlSAXHandler handler;
+
+    d->m_arena.clear();
+    d->m_records.clear();
+    d->m_resources.clear();
+    d->m_lastError.clear();
+    d->m_depth = 0;
+    d->m_inObject = false;
+    d->m_property = DIDLLiteStreamParserPrivate::PropertyNone;
+
+    memset(&handler, 0, sizeof(xmlSAXHandler));
+    handler.initialized = XML_SAX2_MAGIC;
+    handler.startElementNs = DIDLLiteStreamParserPrivate::onStartElement;
+    handler.endElementNs = DIDLLiteStreamParserPrivate::onEndElement;
+    handler.characters = DIDLLiteStreamParserPrivate::onCharacters;
+    handler.cdataBlock = DIDLLiteStreamParserPrivate::onCharacters;
+
+    xmlParserCtxtPtr context = xmlCreateMemoryParserCtxt(didlLite, length);
+    if (context == 0) {
+        d->m_lastError = QLatin1String("Failed to create parser context");
+
+        return false;
+    }
+
+    // Needs to be done before replacing the handler. No XML_PARSE_NOENT,
+    // that would substitute DTD entities of documents from any server;
+    // attribute() takes care of &amp; instead
+    xmlCtxtUseOptions(context, XML_PARSE_NONET);
+
+    xmlSAXHandlerPtr defaultHandler = context->sax;
+    context->sax = &handler;
+    context->userData = d;
+
+    xmlParseDocument(context);
+    bool result = context->wellFormed != 0;
+    if (not result) {
+        xmlErrorPtr error = xmlCtxtGetLastError(context);
+        d->m_lastError = QString::fromUtf8(error != 0 ? error->message : "Invalid DIDL-Lite");
+    }
+
+    context->sax = defaultHandler;
+    xmlFreeParserCtxt(context);
+
+    return result;
+}
+
+/*!
+ * \brief Get the objects of the last parse().
+ *
+ * The strings of the records point into the parser's arena and are only
+ * valid until the next parse() or until the parser is destroyed.
+ */
+const QVector<DIDLLiteRecord> &DIDLLiteStreamParser::records() const
+{
+    Q_D(const DIDLLiteStreamParser);
+
+    return d->m_records;
+}
+
+/*!
+ * \brief Get the resources of all objects of the last parse().
+ *
+ * The resources of a record are resources()[firstResource] up to
+ * resources()[firstResource + resourceCount - 1].
+ */
+const QVector<DIDLLiteResourceRecord> &DIDLLiteStreamParser::resources() const
+{
+    Q_D(const DIDLLiteStreamParser);
+
+    return d->m_resources;
+}
+
+/*!
+ * \brief Get the number of bytes used by the result of the last parse().
+ */
+int DIDLLiteStreamParser::memoryUsage() const
+{
+    Q_D(const DIDLLiteStreamParser);
+
+    return d->m_arena.size() +
+           d->m_records.capacity() * sizeof(DIDLLiteRecord) +
+           d->m_resources.capacity() * sizeof(DIDLLiteResourceRecord);
+}
+
+bool DIDLLiteStreamParser::hasError() const
+{
+    Q_D(const DIDLLiteStreamParser);
+
+    return not d->m_lastError.isEmpty();
+}
+
+QString DIDLLiteStreamParser::errorMessage() const
+{
+    Q_D(const DIDLLiteStreamParser);
+
+    return d->m_lastError;
+}
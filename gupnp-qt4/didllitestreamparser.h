@@ -0,0 +1,100 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DIDLLITESTREAMPARSER_H
+#define DIDLLITESTREAMPARSER_H
+
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+/*!
+ * \brief Append-only string storage.
+ *
+ * Strings are copied into big blocks which are never moved, so pointers
+ * returned by add() stay valid until the arena is cleared or destroyed.
+ */
+class DIDLLiteArena
+{
+    Q_DISABLE_COPY(DIDLLiteArena)
+public:
+    DIDLLiteArena();
+    ~DIDLLiteArena();
+
+    const char *add(const char *string, int length);
+    void clear();
+    int size() const;
+
+private:
+    QList<char *> m_blocks;
+    int m_used;
+    int m_size;
+};
+
+struct DIDLLiteResourceRecord {
+    const char *uri;
+    const char *protocolInfo;
+    qint64      size;
+    long        duration;
+    int         width;
+    int         height;
+};
+
+struct DIDLLiteRecord {
+    bool        container;
+    bool        restricted;
+    const char *id;
+    const char *parentId;
+    const char *title;
+    const char *upnpClass;
+    const char *artist;
+    const char *album;
+    const char *albumArtUri;
+    int         originalTrackNumber;
+    int         firstResource;
+    int         resourceCount;
+};
+
+class DIDLLiteStreamParserPrivate;
+
+/*!
+ * \brief SAX based DIDL-Lite parser.
+ *
+ * Unlike DIDLLiteParser, no document tree is built. Only the properties
+ * Helium uses are extracted into flat records; all strings live in the
+ * parser's arena.
+ */
+class DIDLLiteStreamParser
+{
+    Q_DISABLE_COPY(DIDLLiteStreamParser)
+public:
+    DIDLLiteStreamParser();
+    ~DIDLLiteStreamParser();
+
+    bool parse(const char *didlLite, int length);
+    const QVector<DIDLLiteRecord> &records() const;
+    const QVector<DIDLLiteResourceRecord> &resources() const;
+    int memoryUsage() const;
+    bool hasError() const;
+    QString errorMessage() const;
+
+private:
+    DIDLLiteStreamParserPrivate * const d_ptr;
+    Q_DECLARE_PRIVATE(DIDLLiteStreamParser)
+};
+
+#endif // DIDLLITESTREAMPARSER_H
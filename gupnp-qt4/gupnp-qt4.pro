@@ -8,7 +8,9 @@ INCLUDEPATH += ../gupnp-av
 
 HEADERS = didlliteparser.h \
          didlliteparser_p.h \
+         didllitestreamparser.h \
          glib-utils.h \
+         lastchangestreamparser.h \
          refptrg.h \
          serviceproxycall.h \
          serviceproxy.h \
@@ -17,7 +19,9 @@ HEADERS = didlliteparser.h \
          serviceintrospection_p.h
 
 SOURCES = didlliteparser.cpp \
+          didllitestreamparser.cpp \
           glib-utils.cpp \
+          lastchangestreamparser.cpp \
           serviceproxycall.cpp \
           serviceproxy.cpp \
           serviceintrospection.cpp
@@ -0,0 +1,329 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <libxml/parser.h>
+
+#include "lastchangestreamparser.h"
+
+static const struct {
+    const char *name;
+    LastChangeSet::TransportState state;
+} TRANSPORT_STATES[] = {
+    { "STOPPED", LastChangeSet::StateStopped },
+    { "PLAYING", LastChangeSet::StatePlaying },
+    { "PAUSED_PLAYBACK", LastChangeSet::StatePausedPlayback },
+    { "PAUSED_RECORDING", LastChangeSet::StatePausedRecording },
+    { "RECORDING", LastChangeSet::StateRecording },
+    { "TRANSITIONING", LastChangeSet::StateTransitioning },
+    { "NO_MEDIA_PRESENT", LastChangeSet::StateNoMediaPresent },
+    { 0, LastChangeSet::StateUnknown }
+};
+
+/*!
+ * \brief The name AVTransport uses for a TransportState.
+ * \return the name, 0 for StateUnknown.
+ */
+const char *LastChangeSet::stateName(TransportState state)
+{
+    for (int i = 0; TRANSPORT_STATES[i].name != 0; i++) {
+        if (TRANSPORT_STATES[i].state == state) {
+            return TRANSPORT_STATES[i].name;
+        }
+    }
+
+    return 0;
+}
+
+class LastChangeStreamParserPrivate
+{
+public:
+    LastChangeStreamParserPrivate();
+
+    static void onStartElement(void *user_data,
+                               const xmlChar *localname,
+                               const xmlChar *prefix,
+                               const xmlChar *uri,
+                               int nb_namespaces,
+                               const xmlChar **namespaces,
+                               int nb_attributes,
+                               int nb_defaulted,
+                               const xmlChar **attributes);
+    static void onEndElement(void *user_data,
+                             const xmlChar *localname,
+                             const xmlChar *prefix,
+                             const xmlChar *uri);
+
+    static QByteArray attribute(const xmlChar **attributes, int count, const char *name);
+
+    QVector<LastChangeSet> m_changes;
+    QString m_lastError;
+
+    int m_depth;
+    bool m_inInstance;
+};
+
+LastChangeStreamParserPrivate::LastChangeStreamParserPrivate()
+    : m_changes()
+    , m_lastError()
+    , m_depth(0)
+    , m_inInstance(false)
+{
+}
+
+/*!
+ * \brief Look up an attribute of a SAX2 start element.
+ *
+ * Without XML_PARSE_NOENT, libxml2 hands out &amp; in attribute values as
+ * &#38;, the other predefined entities are unescaped already.
+ *
+ * \return the value of the attribute or a null QByteArray if the element
+ *         does not have it.
+ */
+QByteArray LastChangeStreamParserPrivate::attribute(const xmlChar **attributes, int count, const char *name)
+{
+    for (int i = 0; i < count * 5; i += 5) {
+        if (strcmp((const char *) attributes[i], name) == 0) {
+            return QByteArray((const char *) attributes[i + 3],
+                              attributes[i + 4] - attributes[i + 3]).replace("&#38;", "&");
+        }
+    }
+
+    return QByteArray();
+}
+
+// H+:MM:SS[.F+] in milliseconds, -1 for NOT_IMPLEMENTED and the like
+static qint64 parseTime(const QByteArray &time)
+{
+    long hours = 0, minutes = 0, seconds = 0;
+
+    if (sscanf(time.constData(), "%ld:%ld:%ld", &hours, &minutes, &seconds) != 3) {
+        return -1;
+    }
+
+    qint64 milliseconds = (hours * 3600 + minutes * 60 + seconds) * Q_INT64_C(1000);
+    const char *fraction = strchr(time.constData(), '.');
+    if (fraction != 0) {
+        milliseconds += qint64(g_ascii_strtod(fraction, 0) * 1000.0);
+    }
+
+    return milliseconds;
+}
+
+static bool parseBoolean(const QByteArray &value)
+{
+    return value == "1" || g_ascii_strcasecmp(value.constData(), "true") == 0 ||
+           g_ascii_strcasecmp(value.constData(), "yes") == 0;
+}
+
+void LastChangeStreamParserPrivate::onStartElement(void *user_data,
+                                                   const xmlChar *localname,
+                                                   const xmlChar *prefix,
+                                                   const xmlChar *uri,
+                                                   int nb_namespaces,
+                                                   const xmlChar **namespaces,
+                                                   int nb_attributes,
+                                                   int nb_defaulted,
+                                                   const xmlChar **attributes)
+{
+    Q_UNUSED(prefix);
+    Q_UNUSED(uri);
+    Q_UNUSED(nb_namespaces);
+    Q_UNUSED(namespaces);
+    Q_UNUSED(nb_defaulted);
+
+    auto self = static_cast<LastChangeStreamParserPrivate *>(user_data);
+    auto name = (const char *) localname;
+
+    self->m_depth++;
+
+    // <Event><InstanceID val="0"><Variable val="..."/></InstanceID></Event>
+    if (self->m_depth == 2) {
+        self->m_inInstance = strcmp(name, "InstanceID") == 0;
+        if (not self->m_inInstance) {
+            return;
+        }
+
+        LastChangeSet change;
+        change.instanceId = attribute(attributes, nb_attributes, "val").toUInt();
+        change.fields = 0;
+        change.transportState = LastChangeSet::StateUnknown;
+        change.trackDuration = -1;
+        change.volume = 0;
+        change.mute = false;
+        self->m_changes << change;
+
+        return;
+    }
+
+    if (self->m_depth != 3 || not self->m_inInstance) {
+        return;
+    }
+
+    const QByteArray value = attribute(attributes, nb_attributes, "val");
+    if (value.isNull()) {
+        return;
+    }
+
+    LastChangeSet &change = self->m_changes.last();
+
+    // Renderers do not agree on the case of "MetaData"
+    if (g_ascii_strcasecmp(name, "TransportState") == 0) {
+        change.fields |= LastChangeSet::FieldTransportState;
+        for (int i = 0; TRANSPORT_STATES[i].name != 0; i++) {
+            if (value == TRANSPORT_STATES[i].name) {
+                change.transportState = TRANSPORT_STATES[i].state;
+                break;
+            }
+        }
+    } else if (g_ascii_strcasecmp(name, "CurrentTrackDuration") == 0) {
+        change.fields |= LastChangeSet::FieldTrackDuration;
+        change.trackDuration = parseTime(value);
+    } else if (g_ascii_strcasecmp(name, "CurrentTrackURI") == 0) {
+        change.fields |= LastChangeSet::FieldTrackUri;
+        change.trackUri = value;
+    } else if (g_ascii_strcasecmp(name, "CurrentTrackMetaData") == 0) {
+        change.fields |= LastChangeSet::FieldTrackMetaData;
+        change.trackMetaData = value;
+    } else if (g_ascii_strcasecmp(name, "AVTransportURIMetaData") == 0) {
+        change.fields |= LastChangeSet::FieldTransportMetaData;
+        change.transportMetaData = value;
+    } else if (strcmp(name, "Volume") == 0 || strcmp(name, "Mute") == 0) {
+        const QByteArray channel = attribute(attributes, nb_attributes, "channel");
+
+        if (not channel.isNull() && channel != "Master") {
+            return;
+        }
+
+        if (name[0] == 'V') {
+            change.fields |= LastChangeSet::FieldVolume;
+            change.volume = value.toUInt();
+        } else {
+            change.fields |= LastChangeSet::FieldMute;
+            change.mute = parseBoolean(value);
+        }
+    }
+}
+
+void LastChangeStreamParserPrivate::onEndElement(void *user_data,
+                                                 const xmlChar *localname,
+                                                 const xmlChar *prefix,
+                                                 const xmlChar *uri)
+{
+    Q_UNUSED(localname);
+    Q_UNUSED(prefix);
+    Q_UNUSED(uri);
+
+    auto self = static_cast<LastChangeStreamParserPrivate *>(user_data);
+
+    if (self->m_depth == 2) {
+        self->m_inInstance = false;
+    }
+
+    self->m_depth--;
+}
+
+LastChangeStreamParser::LastChangeStreamParser()
+    : d_ptr(new LastChangeStreamParserPrivate)
+{
+}
+
+LastChangeStreamParser::~LastChangeStreamParser()
+{
+    delete d_ptr;
+}
+
+/*!
+ * \brief Parse a LastChange event into LastChangeSets.
+ *
+ * Results of a previous parse() are discarded.
+ *
+ * \param lastChange the UTF-8 encoded value of the LastChange variable
+ * \param length length of lastChange in bytes
+ * \return true on success, false otherwise.
+ * \sa changes(), errorMessage()
+ */
+bool LastChangeStreamParser::parse(const char *lastChange, int length)
+{
+    Q_D(LastChangeStreamParser);
+    xmlSAXHandler handler;
+
+    d->m_changes.clear();
+    d->m_lastError.clear();
+    d->m_depth = 0;
+    d->m_inInstance = false;
+
+    memset(&handler, 0, sizeof(xmlSAXHandler));
+    handler.initialized = XML_SAX2_MAGIC;
+    handler.startElementNs = LastChangeStreamParserPrivate::onStartElement;
+    handler.endElementNs = LastChangeStreamParserPrivate::onEndElement;
+
+    xmlParserCtxtPtr context = xmlCreateMemoryParserCtxt(lastChange, length);
+    if (context == 0) {
+        d->m_lastError = QLatin1String("Failed to create parser context");
+
+        return false;
+    }
+
+    // attribute() unescapes the metadata, which is all it needs.
+    // XML_PARSE_NOENT would substitute DTD entities of an untrusted document
+    // as well.
+    xmlCtxtUseOptions(context, XML_PARSE_NONET);
+
+    xmlSAXHandlerPtr defaultHandler = context->sax;
+    context->sax = &handler;
+    context->userData = d;
+
+    xmlParseDocument(context);
+    bool result = context->wellFormed != 0;
+    if (not result) {
+        xmlErrorPtr error = xmlCtxtGetLastError(context);
+        d->m_lastError = QString::fromUtf8(error != 0 ? error->message : "Invalid LastChange");
+    }
+
+    context->sax = defaultHandler;
+    xmlFreeParserCtxt(context);
+
+    return result;
+}
+
+/*!
+ * \brief Get the changes of the last parse(), one per InstanceID.
+ */
+const QVector<LastChangeSet> &LastChangeStreamParser::changes() const
+{
+    Q_D(const LastChangeStreamParser);
+
+    return d->m_changes;
+}
+
+bool LastChangeStreamParser::hasError() const
+{
+    Q_D(const LastChangeStreamParser);
+
+    return not d->m_lastError.isEmpty();
+}
+
+QString LastChangeStreamParser::errorMessage() const
+{
+    Q_D(const LastChangeStreamParser);
+
+    return d->m_lastError;
+}
@@ -0,0 +1,93 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LASTCHANGESTREAMPARSER_H
+#define LASTCHANGESTREAMPARSER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+/*!
+ * \brief The variables a LastChange event reported for one instance.
+ *
+ * Only the members whose Field is set in fields were part of the event.
+ */
+struct LastChangeSet {
+    enum Field {
+        FieldTransportState = 0x01,
+        FieldTrackDuration = 0x02,
+        FieldTrackUri = 0x04,
+        FieldTrackMetaData = 0x08,
+        FieldTransportMetaData = 0x10,
+        FieldVolume = 0x20,
+        FieldMute = 0x40
+    };
+
+    enum TransportState {
+        StateUnknown,
+        StateStopped,
+        StatePlaying,
+        StatePausedPlayback,
+        StatePausedRecording,
+        StateRecording,
+        StateTransitioning,
+        StateNoMediaPresent
+    };
+
+    bool has(Field field) const { return (fields & field) != 0; }
+    static const char *stateName(TransportState state);
+
+    unsigned int   instanceId;
+    int            fields;
+    TransportState transportState;
+    // in milliseconds, -1 if the renderer does not know
+    qint64         trackDuration;
+    unsigned int   volume;
+    bool           mute;
+    QByteArray     trackUri;
+    QByteArray     trackMetaData;
+    QByteArray     transportMetaData;
+};
+
+class LastChangeStreamParserPrivate;
+
+/*!
+ * \brief SAX based parser for LastChange events of AVTransport and
+ *        RenderingControl.
+ *
+ * Unlike GUPnPLastChangeParser, the event is read once for all variables
+ * and all instances, and the values are converted while reading.
+ */
+class LastChangeStreamParser
+{
+    Q_DISABLE_COPY(LastChangeStreamParser)
+public:
+    LastChangeStreamParser();
+    ~LastChangeStreamParser();
+
+    bool parse(const char *lastChange, int length);
+    const QVector<LastChangeSet> &changes() const;
+    bool hasError() const;
+    QString errorMessage() const;
+
+private:
+    LastChangeStreamParserPrivate * const d_ptr;
+    Q_DECLARE_PRIVATE(LastChangeStreamParser)
+};
+
+#endif // LASTCHANGESTREAMPARSER_H
@@ -18,6 +18,9 @@ along with Helium.  If not, see <http://www.gnu.org/licenses/>.
 #include <libgupnp/gupnp.h>
 #include <gio/gio.h>
 
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
 #include <QtCore/QMap>
 
 #include "refptrg.h"
@@ -26,6 +29,44 @@ along with Helium.  If not, see <http://www.gnu.org/licenses/>.
 #include "serviceproxy.h"
 #include "serviceproxy_p.h"
 
+class ServiceProxyCallPrivate;
+
+/*!
+ * \brief A SOAP action shared by identical calls running at the same time.
+ *
+ * Each ServiceProxyCall running the action holds a reference; the action is
+ * only cancelled once the last of them is cancelled.
+ */
+class ServiceProxySharedAction
+{
+public:
+    ServiceProxySharedAction(GUPnPServiceProxy *proxy,
+                             const QString &key,
+                             const QStringList &results);
+    ~ServiceProxySharedAction();
+
+    static ServiceProxySharedAction *find(const QString &key);
+    static void onAction(GUPnPServiceProxy       *proxy,
+                         GUPnPServiceProxyAction *action,
+                         gpointer                 user_data);
+
+    void begin(const QString &action, const QStringList &names, const QVariantList &values);
+    void ref(ServiceProxyCallPrivate *call);
+    void unref(ServiceProxyCallPrivate *call);
+
+private:
+    static QHash<QString, ServiceProxySharedAction *> running;
+
+    void finish();
+
+    GUPnPServiceProxy * const m_proxy;
+    GUPnPServiceProxyAction *m_action;
+    const QString m_key;
+    const QStringList m_results;
+    QList<ServiceProxyCallPrivate *> m_calls;
+    QElapsedTimer m_timer;
+};
+
 class ServiceProxyCallPrivate
 {
 public:
@@ -41,6 +82,9 @@ public:
                          gpointer                 user_data);
 
     void setReady(GUPnPServiceProxy *proxy, GUPnPServiceProxyAction *action);
+    void runShared();
+    void leaveShared();
+    QString sharingKey() const;
 
     ServiceProxyCall * const q_ptr;
     Q_DECLARE_PUBLIC(ServiceProxyCall)
@@ -54,8 +98,191 @@ public:
     GError *m_lastError;
     QMap<QString, QVariant> m_results;
     ServiceProxyCall *m_next;
+    QElapsedTimer m_timer;
+    qint64 m_elapsed;
+    QStringList m_sharedResults;
+    ServiceProxySharedAction *m_shared;
 };
 
+static GUPnPServiceProxyAction *beginAction(GUPnPServiceProxy *proxy,
+                                            const QString &action,
+                                            const QStringList &names,
+                                            const QVariantList &values,
+                                            GUPnPServiceProxyActionCallback callback,
+                                            gpointer user_data)
+{
+    GList *inNames = 0, *inValues = 0;
+
+    Q_FOREACH(QString name, names) {
+        inNames = g_list_append(inNames, (gpointer) g_strdup(name.toUtf8().constData()));
+    }
+    QGListFullScopedPointer namesPointer(inNames);
+
+    Q_FOREACH(QVariant value, values) {
+        auto gvalue = qVariantToGValue(value);
+        inValues = g_list_append(inValues, (gpointer)gvalue);
+    }
+
+    GUPnPServiceProxyAction *result = gupnp_service_proxy_begin_action_list(proxy,
+                                                                           action.toUtf8().constData(),
+                                                                           inNames,
+                                                                           inValues,
+                                                                           callback,
+                                                                           user_data);
+
+    namesPointer.reset();
+    auto it = inValues;
+    while (it != 0) {
+        g_value_reset((GValue *)it->data);
+        g_free(it->data);
+        it = it->next;
+    }
+
+    return result;
+}
+
+/*!
+ * \brief Collect the out-arguments params of a finished action into results.
+ */
+static void endAction(GUPnPServiceProxy *proxy,
+                      GUPnPServiceProxyAction *action,
+                      const QStringList &params,
+                      GError **error,
+                      QMap<QString, QVariant> *results)
+{
+    GList *outNames = 0, *outTypes = 0, *outValues = 0;
+
+    Q_FOREACH(const QString &name, params) {
+        outNames = g_list_append(outNames, (gpointer)g_strdup(name.toUtf8().constData()));
+        outTypes = g_list_append(outTypes, GSIZE_TO_POINTER(G_TYPE_STRING));
+    }
+
+    QGListFullScopedPointer names(outNames);
+    QGListScopedPointer types(outTypes);
+
+    gboolean result = gupnp_service_proxy_end_action_list(proxy,
+                                                          action,
+                                                          error,
+                                                          outNames, outTypes, &outValues);
+    if (not result) {
+        return;
+    }
+
+    GList *it = outValues, *it2 = outNames;
+
+    while (it != 0) {
+        results->insert(QString::fromUtf8((const char *)it2->data),
+                        QVariant::fromValue(QString::fromUtf8(g_value_get_string((GValue *)it->data))));
+        it = it->next;
+        it2 = it2->next;
+    }
+
+    names.reset();
+    types.reset();
+}
+
+QHash<QString, ServiceProxySharedAction *> ServiceProxySharedAction::running;
+
+ServiceProxySharedAction::ServiceProxySharedAction(GUPnPServiceProxy *proxy,
+                                                   const QString &key,
+                                                   const QStringList &results)
+    : m_proxy(GUPNP_SERVICE_PROXY(g_object_ref(proxy)))
+    , m_action(0)
+    , m_key(key)
+    , m_results(results)
+    , m_calls()
+    , m_timer()
+{
+    running.insert(m_key, this);
+}
+
+ServiceProxySharedAction::~ServiceProxySharedAction()
+{
+    running.remove(m_key);
+    g_object_unref(m_proxy);
+}
+
+/*!
+ * \brief The action identical calls are waiting for, if any.
+ */
+ServiceProxySharedAction *ServiceProxySharedAction::find(const QString &key)
+{
+    return running.value(key);
+}
+
+void ServiceProxySharedAction::begin(const QString &action,
+                                     const QStringList &names,
+                                     const QVariantList &values)
+{
+    m_timer.start();
+    m_action = beginAction(m_proxy, action, names, values,
+                           ServiceProxySharedAction::onAction, this);
+}
+
+void ServiceProxySharedAction::ref(ServiceProxyCallPrivate *call)
+{
+    m_calls << call;
+}
+
+/*!
+ * \brief Drop the reference of a call; cancels the action if it was the last.
+ */
+void ServiceProxySharedAction::unref(ServiceProxyCallPrivate *call)
+{
+    m_calls.removeOne(call);
+    if (not m_calls.isEmpty()) {
+        return;
+    }
+
+    if (m_action != 0) {
+        gupnp_service_proxy_cancel_action(m_proxy, m_action);
+    }
+    delete this;
+}
+
+void ServiceProxySharedAction::onAction(GUPnPServiceProxy       *proxy,
+                                        GUPnPServiceProxyAction *action,
+                                        gpointer                 user_data)
+{
+    auto self = static_cast<ServiceProxySharedAction *>(user_data);
+
+    if (proxy == self->m_proxy && action == self->m_action) {
+        self->finish();
+    }
+}
+
+/*!
+ * \brief Hand the result of the action to all calls waiting for it.
+ */
+void ServiceProxySharedAction::finish()
+{
+    GError *error = 0;
+    QMap<QString, QVariant> results;
+    const qint64 elapsed = m_timer.elapsed();
+
+    endAction(m_proxy, m_action, m_results, &error, &results);
+    m_action = 0;
+
+    if (m_calls.count() > 1) {
+        qDebug() << "Shared one call between" << m_calls.count() << "callers";
+    }
+
+    Q_FOREACH(ServiceProxyCallPrivate *call, m_calls) {
+        call->m_shared = 0;
+        call->m_results = results;
+        call->m_lastError = error != 0 ? g_error_copy(error) : 0;
+        call->m_elapsed = elapsed;
+        call->m_ready = true;
+        QMetaObject::invokeMethod(call->q_ptr, "ready", Qt::QueuedConnection);
+    }
+
+    if (error != 0) {
+        g_error_free(error);
+    }
+
+    delete this;
+}
+
 ServiceProxyCallPrivate::ServiceProxyCallPrivate(ServiceProxyCall   *parent,
                                                  GUPnPServiceProxy  *proxy,
                                                  const QString      &action,
@@ -71,6 +298,10 @@ ServiceProxyCallPrivate::ServiceProxyCallPrivate(ServiceProxyCall   *parent,
     , m_lastError(0)
     , m_results()
     , m_next(0)
+    , m_timer()
+    , m_elapsed(-1)
+    , m_sharedResults()
+    , m_shared(0)
 {
 }
 
@@ -101,10 +332,59 @@ void ServiceProxyCallPrivate::setReady(GUPnPServiceProxy *proxy, GUPnPServicePro
 
     m_ready = proxy == m_proxy && action == m_action;
     if (m_ready) {
+        m_elapsed = m_timer.elapsed();
         QMetaObject::invokeMethod(q, "ready", Qt::QueuedConnection);
     }
 }
 
+/*!
+ * \brief Calls with the same key can share one action.
+ *
+ * The key is made of the control url, the action, its arguments and the
+ * results collected.
+ */
+QString ServiceProxyCallPrivate::sharingKey() const
+{
+    // Different proxies may wrap the same service of a device
+    ScopedGPointer url(gupnp_service_info_get_control_url(GUPNP_SERVICE_INFO(m_proxy)));
+    QString key = QString::fromUtf8(url.data()) + QLatin1Char('#') + m_actionName;
+
+    for (int i = 0; i < m_names.count() && i < m_values.count(); i++) {
+        key += QLatin1Char('\n') + m_names.at(i) + QLatin1Char('=') + m_values.at(i).toString();
+    }
+    key += QLatin1Char('\n') + m_sharedResults.join(QLatin1String(","));
+
+    return key;
+}
+
+/*!
+ * \brief Join an identical action in flight or start a new shared one.
+ */
+void ServiceProxyCallPrivate::runShared()
+{
+    const QString key = sharingKey();
+    ServiceProxySharedAction *shared = ServiceProxySharedAction::find(key);
+
+    if (shared == 0) {
+        shared = new ServiceProxySharedAction(m_proxy, key, m_sharedResults);
+        shared->begin(m_actionName, m_names, m_values);
+    } else {
+        qDebug() << "Joining" << m_actionName << "call already in flight";
+    }
+
+    shared->ref(this);
+    m_shared = shared;
+}
+
+void ServiceProxyCallPrivate::leaveShared()
+{
+    if (m_shared != 0) {
+        // may delete the shared action
+        m_shared->unref(this);
+        m_shared = 0;
+    }
+}
+
 ServiceProxyCall::ServiceProxyCall(ServiceProxy *parent,
                                    const QString &action,
                                    const QStringList &params,
@@ -118,6 +398,18 @@ ServiceProxyCall::ServiceProxyCall(ServiceProxy *parent,
 {
 }
 
+ServiceProxyCall::ServiceProxyCall(const ServiceProxyCallPrivate *other,
+                                   QObject *parent)
+    : QObject(parent)
+    , d_ptr(new ServiceProxyCallPrivate(this,
+                                        other->m_proxy,
+                                        other->m_actionName,
+                                        other->m_names,
+                                        other->m_values))
+{
+    d_ptr->m_sharedResults = other->m_sharedResults;
+}
+
 ServiceProxyCall::~ServiceProxyCall()
 {
     cancel();
@@ -127,43 +419,48 @@ ServiceProxyCall::~ServiceProxyCall()
 void ServiceProxyCall::run(void)
 {
     Q_D(ServiceProxyCall);
-    GList *inNames = 0, *inValues = 0;
-
-    Q_FOREACH(QString name, d->m_names) {
-        inNames = g_list_append(inNames, (gpointer) g_strdup(name.toUtf8().constData()));
-    }
-    QGListFullScopedPointer names(inNames);
-
-    Q_FOREACH(QVariant value, d->m_values) {
-        auto gvalue = qVariantToGValue(value);
-        inValues = g_list_append(inValues, (gpointer)gvalue);
-    }
 
     if (d->m_lastError != 0) {
         g_error_free(d->m_lastError);
         d->m_lastError = 0;
     }
 
-    d->m_action = gupnp_service_proxy_begin_action_list(d->m_proxy,
-                                                        d->m_actionName.toUtf8().constData(),
-                                                        inNames,
-                                                        inValues,
-                                                        ServiceProxyCallPrivate::onAction,
-                                                        d);
+    d->m_elapsed = -1;
+    if (not d->m_sharedResults.isEmpty()) {
+        d->leaveShared();
+        d->m_ready = false;
+        d->m_results.clear();
+        d->runShared();
 
-    names.reset();
-    auto it = inValues;
-    while (it != 0) {
-        g_value_reset((GValue *)it->data);
-        g_free(it->data);
-        it = it->next;
+        return;
     }
+
+    d->m_timer.start();
+    d->m_action = beginAction(d->m_proxy,
+                              d->m_actionName,
+                              d->m_names,
+                              d->m_values,
+                              ServiceProxyCallPrivate::onAction,
+                              d);
 }
 
 void ServiceProxyCall::cancel(void)
 {
     Q_D(ServiceProxyCall);
 
+    if (d->m_shared != 0) {
+        // Other calls may still wait for the shared action
+        d->leaveShared();
+        if (d->m_lastError != 0) {
+            g_error_free(d->m_lastError);
+        }
+        d->m_lastError = g_error_new_literal(G_IO_ERROR, G_IO_ERROR_CANCELLED, "Action cancelled by user");
+
+        Q_EMIT ready();
+
+        return;
+    }
+
     if (d->m_ready || d->m_action == 0) {
         // only need to cancel if action hasn't already returned
         return;
@@ -187,6 +484,18 @@ bool ServiceProxyCall::cancelled(void) const
     return (d != 0 && hasError() && errorCode() == G_IO_ERROR_CANCELLED);
 }
 
+/*!
+ * \brief Get the round-trip time of the call.
+ * \return milliseconds between run() and the reply of the remote device, or
+ * -1 if the call has not finished yet.
+ */
+qint64 ServiceProxyCall::elapsed(void) const
+{
+    Q_D(const ServiceProxyCall);
+
+    return d->m_elapsed;
+}
+
 #define _ADD_ARG(arg) \
     do { \
         if (not (arg).isEmpty()) { \
@@ -203,40 +512,13 @@ void ServiceProxyCall::finalize(const QStringList &params)
     Q_D(ServiceProxyCall);
 
     if (d->m_action == 0) {
-        // finalize called, cancel() called or not started yet
+        // finalize called, cancel() called, not started yet or shared; the
+        // results of a shared action are already collected
         return;
     }
 
-    GList *outNames = 0, *outTypes = 0, *outValues = 0;
-
-    Q_FOREACH(const QString &name, params) {
-        outNames = g_list_append(outNames, (gpointer)g_strdup(name.toUtf8().constData()));
-        outTypes = g_list_append(outTypes, GSIZE_TO_POINTER(G_TYPE_STRING));
-    }
-
-    QGListFullScopedPointer names(outNames);
-    QGListScopedPointer types(outTypes);
-
-    gboolean result = gupnp_service_proxy_end_action_list(d->m_proxy,
-                                                          d->m_action,
-                                                          &(d->m_lastError),
-                                                          outNames, outTypes, &outValues);
+    endAction(d->m_proxy, d->m_action, params, &(d->m_lastError), &(d->m_results));
     d->m_action = 0;
-    if (not result) {
-        return;
-    }
-
-    GList *it = outValues, *it2 = outNames;
-
-    while (it != 0) {
-        d->m_results.insert(QString::fromUtf8((const char *)it2->data),
-                            QVariant::fromValue(QString::fromUtf8(g_value_get_string((GValue *)it->data))));
-        it = it->next;
-        it2 = it2->next;
-    }
-
-    names.reset();
-    types.reset();
 }
 
 bool ServiceProxyCall::hasError(void) const
@@ -327,3 +609,45 @@ void ServiceProxyCall::setNext(ServiceProxyCall *next)
 
     d->m_next = next;
 }
+
+/*!
+ * \brief Create a new call with the same action and arguments.
+ *
+ * Only the action and its in-arguments are copied; results, errors and the
+ * next call are not. The new call is not started.
+ *
+ * \param parent the QObject parent of the new call.
+ * \return a new ServiceProxyCall object.
+ */
+ServiceProxyCall *ServiceProxyCall::clone(QObject *parent) const
+{
+    Q_D(const ServiceProxyCall);
+
+    return new ServiceProxyCall(d, parent);
+}
+
+/*!
+ * \brief Share the action with identical calls running at the same time.
+ *
+ * When run() finds a shared call with the same action and arguments already
+ * waiting for its reply, no new action is started; all calls get the same
+ * result once it arrives. Cancelling one of them leaves the action running
+ * for the others. Clones of the call are shared as well.
+ *
+ * \param results the out-arguments to collect for every caller; finalize()
+ *        does not collect anything else for a shared call. An empty list
+ *        stops sharing.
+ */
+void ServiceProxyCall::setShared(const QStringList &results)
+{
+    Q_D(ServiceProxyCall);
+
+    d->m_sharedResults = results;
+}
+
+bool ServiceProxyCall::shared(void) const
+{
+    Q_D(const ServiceProxyCall);
+
+    return not d->m_sharedResults.isEmpty();
+}
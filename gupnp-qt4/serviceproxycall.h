@@ -48,6 +48,10 @@ public:
     ServiceProxyCall *next(void) const;
     void setNext(ServiceProxyCall *next);
     bool cancelled(void) const;
+    qint64 elapsed(void) const;
+    ServiceProxyCall *clone(QObject *parent = 0) const;
+    void setShared(const QStringList &results);
+    bool shared(void) const;
 
 Q_SIGNALS:
     void ready(void);
@@ -59,6 +63,7 @@ public Q_SLOTS:
 protected:
     ServiceProxyCallPrivate * const d_ptr;
 private:
+    ServiceProxyCall(const ServiceProxyCallPrivate *other, QObject *parent);
     Q_DECLARE_PRIVATE(ServiceProxyCall)
 };
 
@@ -33,6 +33,7 @@ along with Helium.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "networkcontrol.h"
 #include "settings.h"
+#include "thumbnailprovider.h"
 
 #include "version.h"
 
@@ -90,6 +91,7 @@ Q_DECL_EXPORT int main(int argc, char *argv[])
     rootContext->setContextProperty(QLatin1String("feedback"), &effect);
     rootContext->setContextProperty(QLatin1String("settings"), &settings);
     rootContext->setContextProperty(QLatin1String("VERSION"), version);
+    viewer.engine()->addImageProvider(QLatin1String("thumbnail"), new ThumbnailProvider);
     viewer.setOrientation(QmlApplicationViewer::ScreenOrientationLockPortrait);
     viewer.setMainQmlFile(QLatin1String("qml/Helium/main.qml"));
     viewer.showExpanded();
@@ -24,16 +24,30 @@ import "../components"
 Page {
     property alias page: pageHeader.text
 
+    // row the context menu was opened for
+    property string contextType
+    property string contextId
+
     function setUri(r) {
-        var uri = browseListView.currentItem.myModel.uri;
-        var metadata = browseListView.currentItem.myModel.metadata;
-        r.setUriAndPlay(uri, metadata);
+        if (contextType === "container") {
+            r.playContainer(server, contextId);
+        } else {
+            r.playFrom(browseModel, browseListView.currentIndex);
+        }
     }
 
     RendererSheet {
         id: rendererSheet
     }
 
+    // Let servers leave out what the delegate does not show
+    Binding {
+        target: server
+        property: "browseRoles"
+        value: settings.displayMediaArt ? ["title", "upnpId", "upnpClass", "type", "detail", "uri", "metadata", "icon"]
+                                        : ["title", "upnpId", "upnpClass", "type", "detail", "uri", "metadata"]
+    }
+
     Menu {
         id: itemContextMenu
         visualParent: main.tabs.currentTab
@@ -123,7 +137,28 @@ Page {
             id: searchEntry
             anchors.centerIn: parent
             width: parent.width - 10
-            onTextChanged: browseModel.setFilterFixedString(text)
+            onTextChanged: {
+                // let the server search if it can, see searchTimer
+                if (server.canSearch) {
+                    searchTimer.restart()
+
+                    return;
+                }
+
+                // filtering needs the whole container, which is not kept
+                // loaded once the filter is gone again
+                browseModel.lazy = (text === "")
+                browseModel.setFilterText(text)
+            }
+        }
+
+        Timer {
+            id: searchTimer
+            interval: 500
+            repeat: false
+            running: false
+
+            onTriggered: server.search(searchEntry.text, renderer.protocolInfo)
         }
 
         states : [
@@ -175,6 +210,9 @@ Page {
             currentIndex: browseModel.lastIndex
             highlightMoveSpeed: -1
 
+            // last row handed to fetchUpTo(), -2 if none yet
+            property int lastVisibleIndex: -2
+
             Timer {
                 id: timer
                 interval: 1000
@@ -194,17 +232,32 @@ Page {
                 }
             }
 
-            // Clear search entry
+            // only tell the model when another row comes into view, not for
+            // every pixel scrolled
+            onContentYChanged: {
+                var index = indexAt(0, contentY + height)
+
+                if (index !== lastVisibleIndex) {
+                    lastVisibleIndex = index
+                    browseModel.fetchUpTo(index)
+                }
+            }
+
+            // Clear search entry, unless the model holds its search results
             onModelChanged: {
-                searchEntryBack.state = "disabled"
-                searchEntry.text = ""
+                lastVisibleIndex = -2
+                if (browseModel.searchText === "") {
+                    searchEntryBack.state = "disabled"
+                    searchEntry.text = ""
+                }
             }
 
             delegate: BrowseDelegate {
                 mainText: model.title
                 subText: model.detail
-                image: model.icon
-                iconAnnotated: model.uri === "" && model.type !== "container"
+                // icon is only fetched from servers when it is shown
+                image: settings.displayMediaArt ? model.icon : ""
+                iconAnnotated: model.uri === "" && model.type === "object"
                 iconVisible: settings.displayMediaArt
                 drillDown: model.type === "container"
 
@@ -225,13 +278,18 @@ Page {
                     feedback.start();
                     if (settings.showDevicePopUp) {
                         browseModel.lastIndex = index
+                        contextType = type
+                        contextId = upnpId
                             if (itemContextMenu.status === DialogStatus.Closed) {
                                 itemContextMenu.open();
                             } else {
                                 itemContextMenu.close();
                             }
                     } else {
-                        if (uri !== "") {
+                        // a container is played with everything below it
+                        if (type === "container") {
+                            renderer.playContainer(server, upnpId);
+                        } else if (uri !== "") {
                             renderer.setUriAndPlay(uri, metadata);
                         }
                     }
@@ -32,6 +32,9 @@ class Settings : public QObject
     Q_PROPERTY(bool filterInDetails READ filterInDetails WRITE setFilterInDetails NOTIFY filterInDetailsChanged)
     Q_PROPERTY(bool debug READ debug WRITE setDebug NOTIFY debugChanged)
     Q_PROPERTY(QString debugPath READ debugPath WRITE setDebugPath NOTIFY debugPathChanged)
+    Q_PROPERTY(int browseRequests READ browseRequests WRITE setBrowseRequests NOTIFY browseRequestsChanged)
+    Q_PROPERTY(int browseRowBudget READ browseRowBudget WRITE setBrowseRowBudget NOTIFY browseRowBudgetChanged)
+    Q_PROPERTY(int browseInsertInterval READ browseInsertInterval WRITE setBrowseInsertInterval NOTIFY browseInsertIntervalChanged)
 public:
     static const QString RYGEL_DBUS_IFACE;
 
@@ -61,6 +64,15 @@ public:
     QString debugPath(void);
     void setDebugPath(const QString &path);
 
+    int browseRequests(void);
+    void setBrowseRequests(int value);
+
+    int browseRowBudget(void);
+    void setBrowseRowBudget(int value);
+
+    int browseInsertInterval(void);
+    void setBrowseInsertInterval(int value);
+
 Q_SIGNALS:
     void displayDeviceIconsChanged(void);
     void displayMediaArtChanged(void);
@@ -70,6 +82,9 @@ Q_SIGNALS:
     void filterInDetailsChanged(void);
     void debugChanged(void);
     void debugPathChanged(void);
+    void browseRequestsChanged(void);
+    void browseRowBudgetChanged(void);
+    void browseInsertIntervalChanged(void);
 
 private:
     SettingsPrivate * const d_ptr;
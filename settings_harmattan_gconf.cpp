@@ -40,6 +40,9 @@ static const QString SHOW_DEVICE_POPUP = GCONF_PREFIX + QLatin1String ("/Display
 static const QString FILTER_IN_DETAILS = GCONF_PREFIX + QLatin1String ("/Display/filter-in-details");
 static const QString DEBUG = GCONF_PREFIX + QLatin1String("/Debug/enabled");
 static const QString DEBUG_PATH = GCONF_PREFIX + QLatin1String("/Debug/output-path");
+static const QString BROWSE_REQUESTS = GCONF_PREFIX + QLatin1String("/Browse/parallel-requests");
+static const QString BROWSE_ROW_BUDGET = GCONF_PREFIX + QLatin1String("/Browse/row-budget");
+static const QString BROWSE_INSERT_INTERVAL = GCONF_PREFIX + QLatin1String("/Browse/insert-interval");
 
 const QString Settings::RYGEL_DBUS_IFACE = QLatin1String("org.gnome.Rygel1");
 
@@ -52,7 +55,10 @@ SettingsPrivate::SettingsPrivate()
                            << SHOW_DEVICE_POPUP
                            << FILTER_IN_DETAILS
                            << DEBUG
-                           << DEBUG_PATH)
+                           << DEBUG_PATH
+                           << BROWSE_REQUESTS
+                           << BROWSE_ROW_BUDGET
+                           << BROWSE_INSERT_INTERVAL)
 {
     Q_FOREACH(const QString &key, m_keys) {
         m_configItems[key] = new GConfItem(key);
@@ -82,6 +88,9 @@ Settings::Settings(QObject *parent)
     connect (d->m_configItems[FILTER_IN_DETAILS], SIGNAL(valueChanged()), SIGNAL(filterInDetailsChanged()));
     connect (d->m_configItems[DEBUG], SIGNAL(valueChanged()), SIGNAL(debugChanged()));
     connect (d->m_configItems[DEBUG_PATH], SIGNAL(valueChanged()), SIGNAL(debugPathChanged()));
+    connect (d->m_configItems[BROWSE_REQUESTS], SIGNAL(valueChanged()), SIGNAL(browseRequestsChanged()));
+    connect (d->m_configItems[BROWSE_ROW_BUDGET], SIGNAL(valueChanged()), SIGNAL(browseRowBudgetChanged()));
+    connect (d->m_configItems[BROWSE_INSERT_INTERVAL], SIGNAL(valueChanged()), SIGNAL(browseInsertIntervalChanged()));
 }
 
 Settings::~Settings()
@@ -194,3 +203,45 @@ void Settings::setDebugPath(const QString &value)
 
     d->m_configItems[DEBUG_PATH]->set(value);
 }
+
+int Settings::browseRequests(void)
+{
+    Q_D(Settings);
+
+    return d->m_configItems[BROWSE_REQUESTS]->value(4).toInt();
+}
+
+void Settings::setBrowseRequests(int value)
+{
+    Q_D(Settings);
+
+    d->m_configItems[BROWSE_REQUESTS]->set(value);
+}
+
+int Settings::browseRowBudget(void)
+{
+    Q_D(Settings);
+
+    return d->m_configItems[BROWSE_ROW_BUDGET]->value(5000).toInt();
+}
+
+void Settings::setBrowseRowBudget(int value)
+{
+    Q_D(Settings);
+
+    d->m_configItems[BROWSE_ROW_BUDGET]->set(value);
+}
+
+int Settings::browseInsertInterval(void)
+{
+    Q_D(Settings);
+
+    return d->m_configItems[BROWSE_INSERT_INTERVAL]->value(16).toInt();
+}
+
+void Settings::setBrowseInsertInterval(int value)
+{
+    Q_D(Settings);
+
+    d->m_configItems[BROWSE_INSERT_INTERVAL]->set(value);
+}
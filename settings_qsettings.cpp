@@ -35,6 +35,9 @@ static const QString SHOW_DEVICE_POPUP = QLatin1String ("Display/show-device-pop
 static const QString FILTER_IN_DETAILS = QLatin1String ("Display/filter-in-details");
 static const QString DEBUG = QLatin1String ("Debug/enable");
 static const QString DEBUG_PATH = QLatin1String ("Debug/output-path");
+static const QString BROWSE_REQUESTS = QLatin1String ("Browse/parallel-requests");
+static const QString BROWSE_ROW_BUDGET = QLatin1String ("Browse/row-budget");
+static const QString BROWSE_INSERT_INTERVAL = QLatin1String ("Browse/insert-interval");
 
 SettingsPrivate::SettingsPrivate(Settings *parent)
     : QObject(parent)
@@ -94,6 +97,21 @@ void SettingsPrivate::onFileChanged(const QString &path)
         m_valueCache[DEBUG_PATH] = q->debugPath();
         Q_EMIT q->debugPathChanged();
     }
+
+    if (m_valueCache[BROWSE_REQUESTS] != q->browseRequests()) {
+        m_valueCache[BROWSE_REQUESTS] = q->browseRequests();
+        Q_EMIT q->browseRequestsChanged();
+    }
+
+    if (m_valueCache[BROWSE_ROW_BUDGET] != q->browseRowBudget()) {
+        m_valueCache[BROWSE_ROW_BUDGET] = q->browseRowBudget();
+        Q_EMIT q->browseRowBudgetChanged();
+    }
+
+    if (m_valueCache[BROWSE_INSERT_INTERVAL] != q->browseInsertInterval()) {
+        m_valueCache[BROWSE_INSERT_INTERVAL] = q->browseInsertInterval();
+        Q_EMIT q->browseInsertIntervalChanged();
+    }
 }
 
 Settings::Settings(QObject *parent)
@@ -213,3 +231,48 @@ void Settings::setDebugPath(const QString &value)
     d->set(DEBUG_PATH, value);
     Q_EMIT debugPathChanged();
 }
+
+int Settings::browseRequests()
+{
+    Q_D(Settings);
+
+    return d->m_settings.value(BROWSE_REQUESTS, 4).toInt();
+}
+
+void Settings::setBrowseRequests(int value)
+{
+    Q_D(Settings);
+
+    d->set(BROWSE_REQUESTS, value);
+    Q_EMIT browseRequestsChanged();
+}
+
+int Settings::browseRowBudget()
+{
+    Q_D(Settings);
+
+    return d->m_settings.value(BROWSE_ROW_BUDGET, 5000).toInt();
+}
+
+void Settings::setBrowseRowBudget(int value)
+{
+    Q_D(Settings);
+
+    d->set(BROWSE_ROW_BUDGET, value);
+    Q_EMIT browseRowBudgetChanged();
+}
+
+int Settings::browseInsertInterval()
+{
+    Q_D(Settings);
+
+    return d->m_settings.value(BROWSE_INSERT_INTERVAL, 16).toInt();
+}
+
+void Settings::setBrowseInsertInterval(int value)
+{
+    Q_D(Settings);
+
+    d->set(BROWSE_INSERT_INTERVAL, value);
+    Q_EMIT browseInsertIntervalChanged();
+}
@@ -0,0 +1,370 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDesktopServices>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
+
+#include "thumbnailprovider.h"
+
+const int ThumbnailCache::THUMBNAIL_SIZE = 64;
+
+// Number of thumbnails fetched at the same time
+const int MAX_FETCHES = 4;
+
+// Thumbnails waiting to be fetched; older ones were scrolled past already
+const int MAX_QUEUE = 64;
+
+// Decoded thumbnails kept in memory
+const int MEMORY_CACHE_SIZE = 8 * 1024 * 1024;
+
+// Time before a thumbnail which failed to load is tried again
+const qint64 FAILURE_TIMEOUT = 5 * 60 * 1000;
+
+// Thumbnails on disk; the least recently written are removed beyond it
+const qint64 MAX_DISK_CACHE_SIZE = 16 * 1024 * 1024;
+
+// Thumbnails written between two prunes of the disk cache
+const int PRUNE_INTERVAL = 100;
+
+/*!
+ * \brief Decode and scale a thumbnail, then hand it to the ThumbnailCache.
+ *
+ * If data is empty, the thumbnail is read from the disk cache, otherwise
+ * it is written there after scaling.
+ */
+class ThumbnailDecoder : public QRunnable
+{
+public:
+    ThumbnailDecoder(const QString &url, const QString &path, const QByteArray &data = QByteArray())
+        : QRunnable()
+        , m_url(url)
+        , m_path(path)
+        , m_data(data)
+    {
+    }
+
+    void run()
+    {
+        QImage image;
+        bool cached = m_data.isEmpty();
+
+        if (cached) {
+            image.load(m_path, "JPEG");
+        } else {
+            QBuffer buffer(&m_data);
+            QImageReader reader(&buffer);
+            QSize size = reader.size();
+
+            // Let the decoder scale; for JPEG this skips most of the work
+            if (size.isValid() &&
+                (size.width() > ThumbnailCache::THUMBNAIL_SIZE ||
+                 size.height() > ThumbnailCache::THUMBNAIL_SIZE)) {
+                size.scale(ThumbnailCache::THUMBNAIL_SIZE,
+                           ThumbnailCache::THUMBNAIL_SIZE,
+                           Qt::KeepAspectRatio);
+                reader.setScaledSize(size);
+            }
+            image = reader.read();
+
+            if (not image.isNull()) {
+                QDir().mkpath(QFileInfo(m_path).absolutePath());
+                image.save(m_path, "JPEG", 85);
+            }
+        }
+
+        QMetaObject::invokeMethod(ThumbnailCache::instance(), "onDecoded",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(QString, m_url),
+                                  Q_ARG(QImage, image));
+    }
+
+private:
+    QString    m_url;
+    QString    m_path;
+    QByteArray m_data;
+};
+
+/*!
+ * \brief Remove the least recently written thumbnails beyond
+ *        MAX_DISK_CACHE_SIZE.
+ *
+ * Runs on the thread pool, listing the directory can take a while.
+ */
+class ThumbnailPruner : public QRunnable
+{
+public:
+    explicit ThumbnailPruner(const QString &directory)
+        : QRunnable()
+        , m_directory(directory)
+    {
+    }
+
+    void run()
+    {
+        QDir dir(m_directory);
+        qint64 size = 0;
+        int removed = 0;
+
+        Q_FOREACH(const QFileInfo &info, dir.entryInfoList(QDir::Files, QDir::Time)) {
+            size += info.size();
+            if (size > MAX_DISK_CACHE_SIZE && QFile::remove(info.absoluteFilePath())) {
+                removed++;
+            }
+        }
+
+        if (removed > 0) {
+            qDebug() << "Removed" << removed << "thumbnails from the disk cache";
+        }
+    }
+
+private:
+    QString m_directory;
+};
+
+ThumbnailCache::ThumbnailCache(QObject *parent)
+    : QObject(parent)
+    , m_network()
+    , m_queue()
+    , m_pending()
+    , m_fetches(0)
+    , m_written(0)
+    , m_clock()
+    , m_failed()
+    , m_mutex()
+    , m_images(MEMORY_CACHE_SIZE)
+{
+    m_clock.start();
+    pruneDisk();
+}
+
+ThumbnailCache *ThumbnailCache::instance()
+{
+    static ThumbnailCache *cache = new ThumbnailCache(qApp);
+
+    return cache;
+}
+
+/*!
+ * \brief Map a thumbnail url to one served by the ThumbnailProvider.
+ *
+ * Urls other than http ones, like theme icons, are returned unchanged.
+ *
+ * \return the url for the provider or an empty url if the thumbnail is not
+ *         ready yet. It is loaded in the background then and
+ *         thumbnailReady() is emitted once it is.
+ */
+QUrl ThumbnailCache::thumbnailUrl(const QUrl &url)
+{
+    if (url.scheme() != QLatin1String("http") && url.scheme() != QLatin1String("https")) {
+        return url;
+    }
+
+    const QString key = url.toString();
+    if (not instance()->isReady(key)) {
+        instance()->prefetch(key);
+
+        return QUrl();
+    }
+
+    // hex-encode the url, QML would mangle the escapes of an embedded one
+    return QUrl(QLatin1String("image://thumbnail/") +
+                QString::fromLatin1(key.toUtf8().toHex()));
+}
+
+QString ThumbnailCache::diskDirectory()
+{
+    return QDesktopServices::storageLocation(QDesktopServices::CacheLocation) +
+            QDir::separator() + QLatin1String("thumbnails");
+}
+
+QString ThumbnailCache::diskPath(const QString &url)
+{
+    QByteArray hash = QCryptographicHash::hash(url.toUtf8(), QCryptographicHash::Sha1);
+
+    return diskDirectory() + QDir::separator() +
+            QString::fromLatin1(hash.toHex()) + QLatin1String(".jpg");
+}
+
+void ThumbnailCache::pruneDisk()
+{
+    QThreadPool::globalInstance()->start(new ThumbnailPruner(diskDirectory()));
+}
+
+bool ThumbnailCache::isReady(const QString &url)
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_images.contains(url);
+}
+
+bool ThumbnailCache::hasFailed(const QString &url) const
+{
+    auto it = m_failed.constFind(url);
+
+    return it != m_failed.constEnd() && m_clock.elapsed() - it.value() < FAILURE_TIMEOUT;
+}
+
+/*!
+ * \brief Start loading a thumbnail unless it is already loaded or loading.
+ *
+ * Thumbnails from the disk cache are decoded right away, others are queued
+ * for fetching, most recently requested first.
+ */
+void ThumbnailCache::prefetch(const QString &url)
+{
+    if (isReady(url) || hasFailed(url)) {
+        return;
+    }
+
+    if (m_pending.contains(url)) {
+        // Still queued; move it to the front
+        if (m_queue.removeOne(url)) {
+            m_queue.prepend(url);
+        }
+
+        return;
+    }
+
+    m_pending.insert(url);
+
+    const QString path = diskPath(url);
+    if (QFile::exists(path)) {
+        QThreadPool::globalInstance()->start(new ThumbnailDecoder(url, path));
+
+        return;
+    }
+
+    m_queue.prepend(url);
+    while (m_queue.count() > MAX_QUEUE) {
+        m_pending.remove(m_queue.takeLast());
+    }
+
+    startFetches();
+}
+
+void ThumbnailCache::startFetches()
+{
+    while (m_fetches < MAX_FETCHES && not m_queue.isEmpty()) {
+        const QString url = m_queue.takeFirst();
+        QNetworkReply *reply = m_network.get(QNetworkRequest(QUrl(url)));
+
+        reply->setProperty("thumbnailUrl", url);
+        connect(reply, SIGNAL(finished()), SLOT(onReplyFinished()));
+        m_fetches++;
+    }
+}
+
+void ThumbnailCache::onReplyFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    if (reply == 0) {
+        return;
+    }
+
+    const QString url = reply->property("thumbnailUrl").toString();
+    reply->deleteLater();
+    m_fetches--;
+
+    if (reply->error() != QNetworkReply::NoError) {
+        qDebug() << "Failed to fetch thumbnail" << url << reply->errorString();
+        onDecoded(url, QImage());
+    } else {
+        QThreadPool::globalInstance()->start(new ThumbnailDecoder(url, diskPath(url), reply->readAll()));
+
+        // Every fetched thumbnail is written to disk
+        if (++m_written % PRUNE_INTERVAL == 0) {
+            pruneDisk();
+        }
+    }
+
+    startFetches();
+}
+
+void ThumbnailCache::onDecoded(const QString &url, const QImage &image)
+{
+    m_pending.remove(url);
+
+    if (image.isNull()) {
+        m_failed.insert(url, m_clock.elapsed());
+
+        return;
+    }
+
+    m_failed.remove(url);
+    {
+        QMutexLocker locker(&m_mutex);
+        m_images.insert(url, new QImage(image), image.byteCount());
+    }
+
+    Q_EMIT thumbnailReady(url);
+}
+
+/*!
+ * \brief Get a loaded thumbnail.
+ *
+ * Called from the image loader thread of QML.
+ *
+ * \return the thumbnail or a null image if it is neither in memory nor on
+ *         disk anymore. It is fetched again then.
+ */
+QImage ThumbnailCache::image(const QString &url)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        const QImage *image = m_images.object(url);
+        if (image != 0) {
+            return *image;
+        }
+    }
+
+    // Evicted since thumbnailUrl() handed out the url; the copy on disk is
+    // small enough to be read right here
+    QImage image(diskPath(url), "JPEG");
+    if (image.isNull()) {
+        QMetaObject::invokeMethod(this, "prefetch", Qt::QueuedConnection, Q_ARG(QString, url));
+    }
+
+    return image;
+}
+
+ThumbnailProvider::ThumbnailProvider()
+    : QDeclarativeImageProvider(QDeclarativeImageProvider::Image)
+{
+}
+
+QImage ThumbnailProvider::requestImage(const QString &id, QSize *size, const QSize &/*requestedSize*/)
+{
+    const QString url = QString::fromUtf8(QByteArray::fromHex(id.toLatin1()));
+    QImage image = ThumbnailCache::instance()->image(url);
+
+    if (size != 0) {
+        *size = image.size();
+    }
+
+    return image;
+}
@@ -0,0 +1,104 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THUMBNAILPROVIDER_H
+#define THUMBNAILPROVIDER_H
+
+#include <QCache>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QUrl>
+#include <QtDeclarative/QDeclarativeImageProvider>
+#include <QtNetwork/QNetworkAccessManager>
+
+/*!
+ * \brief Fetches, scales and caches the thumbnails shown in the browse list.
+ *
+ * Thumbnails are fetched with a bounded number of concurrent requests,
+ * decoded and scaled down on the global QThreadPool and kept in an
+ * in-memory LRU. The scaled images are also written to the cache location
+ * as JPEG, so they survive restarts. The oldest of them are removed once
+ * they take more than a fixed size.
+ *
+ * Nothing waits for a thumbnail; thumbnailReady() tells the models when
+ * one they asked for can be shown.
+ */
+class ThumbnailCache : public QObject
+{
+    Q_OBJECT
+public:
+    static const int THUMBNAIL_SIZE;
+
+    static ThumbnailCache *instance();
+    static QUrl thumbnailUrl(const QUrl &url);
+
+    QImage image(const QString &url);
+
+Q_SIGNALS:
+    void thumbnailReady(const QString &url);
+
+public Q_SLOTS:
+    void prefetch(const QString &url);
+
+private Q_SLOTS:
+    void onReplyFinished();
+    void onDecoded(const QString &url, const QImage &image);
+
+private:
+    explicit ThumbnailCache(QObject *parent = 0);
+    static QString diskDirectory();
+    static QString diskPath(const QString &url);
+    void startFetches();
+    void pruneDisk();
+    bool isReady(const QString &url);
+    bool hasFailed(const QString &url) const;
+
+    QNetworkAccessManager   m_network;
+    QStringList             m_queue;
+    QSet<QString>           m_pending;
+    int                     m_fetches;
+    int                     m_written;
+
+    // when each url failed; retried after FAILURE_TIMEOUT
+    QElapsedTimer           m_clock;
+    QHash<QString, qint64>  m_failed;
+
+    // shared with the image loader thread of QML
+    QMutex                  m_mutex;
+    QCache<QString, QImage> m_images;
+};
+
+/*!
+ * \brief Serves "image://thumbnail/" urls from the ThumbnailCache.
+ *
+ * Never waits for the network; thumbnailUrl() only hands out urls of
+ * thumbnails which are ready.
+ */
+class ThumbnailProvider : public QDeclarativeImageProvider
+{
+public:
+    ThumbnailProvider();
+
+    QImage requestImage(const QString &id, QSize *size, const QSize &requestedSize);
+};
+
+#endif // THUMBNAILPROVIDER_H
@@ -0,0 +1,417 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include <QAtomicInt>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDesktopServices>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QRunnable>
+#include <QStringList>
+#include <QThreadPool>
+
+#include "browsecache.h"
+
+const char CACHE_MAGIC[4] = { 'H', 'e', 'B', 'C' };
+const quint32 CACHE_VERSION = 3;
+
+// Oldest files are removed once the cache grows beyond this
+const qint64 MAX_CACHE_SIZE = 64 * 1024 * 1024;
+
+// Files written between two prunes of the cache
+const int PRUNE_INTERVAL = 16;
+
+// store() runs on the thread pool; one file is written at a time
+static QMutex storeMutex;
+static QAtomicInt storeCount;
+
+namespace {
+struct StringRef {
+    quint32 offset;
+    quint32 length;
+};
+
+struct Header {
+    char      magic[4];
+    quint32   version;
+    quint32   rowCount;
+    quint32   resourceCount;
+    quint32   stringCount;
+    quint32   totalMatches;
+    StringRef systemUpdateId;
+    StringRef containerUpdateId;
+};
+
+struct Row {
+    StringRef id;
+    StringRef parentId;
+    StringRef title;
+    StringRef upnpClass;
+    StringRef artist;
+    StringRef album;
+    StringRef albumArtUri;
+    StringRef icon;
+    StringRef detail;
+    StringRef titleKey;
+    StringRef detailKey;
+    quint32   firstResource;
+    quint32   resourceCount;
+    qint32    trackNumber;
+    quint8    container;
+    quint8    restricted;
+};
+
+struct Resource {
+    StringRef uri;
+    StringRef protocolInfo;
+    qint64    size;
+    qint32    duration;
+    qint32    width;
+    qint32    height;
+};
+
+class StringWriter {
+public:
+    StringRef add(const QString &string)
+    {
+        StringRef ref = { quint32(m_data.size()), quint32(string.size()) };
+        m_data += string;
+
+        return ref;
+    }
+
+    const QString &data() const { return m_data; }
+
+private:
+    QString m_data;
+};
+
+class StringReader {
+public:
+    StringReader(const QChar *data, quint32 size)
+        : m_data(data)
+        , m_size(size)
+        , m_valid(true)
+    {
+    }
+
+    QString get(const StringRef &ref)
+    {
+        if (ref.offset > m_size || ref.length > m_size - ref.offset) {
+            m_valid = false;
+
+            return QString();
+        }
+
+        return QString(m_data + ref.offset, ref.length);
+    }
+
+    bool valid() const { return m_valid; }
+
+private:
+    const QChar *m_data;
+    quint32      m_size;
+    bool         m_valid;
+};
+
+class Writer : public QRunnable {
+public:
+    Writer(const QString &key, const BrowseCache::Entry &entry)
+        : QRunnable()
+        , m_key(key)
+        , m_entry(entry)
+    {
+    }
+
+    void run()
+    {
+        BrowseCache::store(m_key, m_entry);
+    }
+
+private:
+    QString            m_key;
+    BrowseCache::Entry m_entry;
+};
+}
+
+/*!
+ * \brief Create the cache key for a Browse call.
+ */
+QString BrowseCache::key(const QString &udn,
+                         const QString &objectId,
+                         const QString &sortCriteria,
+                         const QString &filter)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    Q_FOREACH(const QString &part, QStringList() << udn << objectId << sortCriteria << filter) {
+        hash.addData(part.toUtf8());
+        hash.addData("", 1);
+    }
+
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+QString BrowseCache::path(const QString &key)
+{
+    return QDesktopServices::storageLocation(QDesktopServices::CacheLocation) +
+            QDir::separator() + QLatin1String("browse") + QDir::separator() + key;
+}
+
+/*!
+ * \brief Read a cached Browse result.
+ * \param key as returned by key()
+ * \param entry filled with the cached rows on success
+ * \return false if there is no usable cache file for key
+ */
+bool BrowseCache::load(const QString &key, Entry *entry)
+{
+    QFile file(path(key));
+
+    if (not file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 size = file.size();
+    const uchar *data = file.map(0, size);
+    if (data == 0 || size < qint64(sizeof(Header))) {
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, data, sizeof(Header));
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        header.version != CACHE_VERSION) {
+        file.unmap(const_cast<uchar *>(data));
+
+        return false;
+    }
+
+    const qint64 rowOffset = sizeof(Header);
+    const qint64 resourceOffset = rowOffset + qint64(header.rowCount) * sizeof(Row);
+    const qint64 stringOffset = resourceOffset + qint64(header.resourceCount) * sizeof(Resource);
+    if (stringOffset + qint64(header.stringCount) * sizeof(QChar) != size) {
+        qWarning() << "Ignoring truncated browse cache" << file.fileName();
+        file.unmap(const_cast<uchar *>(data));
+
+        return false;
+    }
+
+    // All tables have an even size, so the strings are suitably aligned
+    StringReader reader(reinterpret_cast<const QChar *>(data + stringOffset), header.stringCount);
+
+    entry->systemUpdateId = reader.get(header.systemUpdateId);
+    entry->containerUpdateId = reader.get(header.containerUpdateId);
+    entry->totalMatches = header.totalMatches;
+    entry->items.clear();
+    entry->items.reserve(header.rowCount);
+
+    for (quint32 i = 0; i < header.rowCount; i++) {
+        Row row;
+        BrowseItem item;
+
+        memcpy(&row, data + rowOffset + i * sizeof(Row), sizeof(Row));
+        item.id = reader.get(row.id);
+        item.parentId = reader.get(row.parentId);
+        item.title = reader.get(row.title);
+        item.upnpClass = reader.get(row.upnpClass);
+        item.artist = reader.get(row.artist);
+        item.album = reader.get(row.album);
+        item.albumArtUri = reader.get(row.albumArtUri);
+        item.icon = QUrl(reader.get(row.icon));
+        item.detail = reader.get(row.detail);
+        item.titleKey = reader.get(row.titleKey);
+        item.detailKey = reader.get(row.detailKey);
+        item.trackNumber = row.trackNumber;
+        item.container = row.container;
+        item.restricted = row.restricted;
+
+        if (row.firstResource > header.resourceCount ||
+            row.resourceCount > header.resourceCount - row.firstResource) {
+            break;
+        }
+
+        for (quint32 j = row.firstResource; j < row.firstResource + row.resourceCount; j++) {
+            Resource res;
+            BrowseResource resource;
+
+            memcpy(&res, data + resourceOffset + j * sizeof(Resource), sizeof(Resource));
+            resource.uri = reader.get(res.uri);
+            resource.protocolInfo = reader.get(res.protocolInfo);
+            resource.size = res.size;
+            resource.duration = res.duration;
+            resource.width = res.width;
+            resource.height = res.height;
+            item.resources << resource;
+        }
+
+        entry->items << item;
+    }
+
+    file.unmap(const_cast<uchar *>(data));
+
+    if (not reader.valid() || quint32(entry->items.count()) != header.rowCount) {
+        qWarning() << "Ignoring corrupt browse cache" << file.fileName();
+        entry->items.clear();
+
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Write a Browse result to the cache, replacing any previous one.
+ *
+ * The least recently written files are pruned every PRUNE_INTERVAL stores.
+ *
+ * \param key as returned by key()
+ * \param entry the rows to store
+ * \return false if the file could not be written
+ */
+bool BrowseCache::store(const QString &key, const Entry &entry)
+{
+    QMutexLocker locker(&storeMutex);
+
+    QVector<Row> rows;
+    QVector<Resource> resources;
+    StringWriter strings;
+    Header header;
+
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.totalMatches = entry.totalMatches;
+    header.systemUpdateId = strings.add(entry.systemUpdateId);
+    header.containerUpdateId = strings.add(entry.containerUpdateId);
+
+    rows.reserve(entry.items.count());
+    Q_FOREACH(const BrowseItem &item, entry.items) {
+        Row row;
+
+        memset(&row, 0, sizeof(Row));
+        row.id = strings.add(item.id);
+        row.parentId = strings.add(item.parentId);
+        row.title = strings.add(item.title);
+        row.upnpClass = strings.add(item.upnpClass);
+        row.artist = strings.add(item.artist);
+        row.album = strings.add(item.album);
+        row.albumArtUri = strings.add(item.albumArtUri);
+        row.icon = strings.add(item.icon.toString());
+        row.detail = strings.add(item.detail);
+        row.titleKey = strings.add(item.titleKey);
+        row.detailKey = strings.add(item.detailKey);
+        row.trackNumber = item.trackNumber;
+        row.container = item.container;
+        row.restricted = item.restricted;
+        row.firstResource = resources.count();
+        row.resourceCount = item.resources.count();
+        rows << row;
+
+        Q_FOREACH(const BrowseResource &resource, item.resources) {
+            Resource res;
+
+            memset(&res, 0, sizeof(Resource));
+            res.uri = strings.add(resource.uri);
+            res.protocolInfo = strings.add(resource.protocolInfo);
+            res.size = resource.size;
+            res.duration = resource.duration;
+            res.width = resource.width;
+            res.height = resource.height;
+            resources << res;
+        }
+    }
+
+    header.rowCount = rows.count();
+    header.resourceCount = resources.count();
+    header.stringCount = strings.data().size();
+
+    const QString fileName = path(key);
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    // Write to a temporary file first so readers never see half a file
+    QFile file(fileName + QLatin1String(".tmp"));
+    if (not file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to open browse cache" << file.fileName() << file.errorString();
+
+        return false;
+    }
+
+    bool ok = file.write(reinterpret_cast<const char *>(&header), sizeof(Header)) == sizeof(Header);
+    ok = ok && file.write(reinterpret_cast<const char *>(rows.constData()),
+                          rows.count() * sizeof(Row)) == qint64(rows.count() * sizeof(Row));
+    ok = ok && file.write(reinterpret_cast<const char *>(resources.constData()),
+                          resources.count() * sizeof(Resource)) == qint64(resources.count() * sizeof(Resource));
+    ok = ok && file.write(reinterpret_cast<const char *>(strings.data().constData()),
+                          header.stringCount * sizeof(QChar)) == qint64(header.stringCount * sizeof(QChar));
+    file.close();
+
+    if (not ok) {
+        qWarning() << "Failed to write browse cache" << file.fileName() << file.errorString();
+        file.remove();
+
+        return false;
+    }
+
+    QFile::remove(fileName);
+    if (not file.rename(fileName)) {
+        file.remove();
+
+        return false;
+    }
+
+    if (storeCount.fetchAndAddRelaxed(1) % PRUNE_INTERVAL == 0) {
+        prune();
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Write a Browse result to the cache on the thread pool.
+ *
+ * Like store(), but serializing large containers does not hold up the GUI.
+ */
+void BrowseCache::storeLater(const QString &key, const Entry &entry)
+{
+    QThreadPool::globalInstance()->start(new Writer(key, entry));
+}
+
+void BrowseCache::remove(const QString &key)
+{
+    QFile::remove(path(key));
+}
+
+/*!
+ * \brief Remove the least recently written files beyond MAX_CACHE_SIZE.
+ */
+void BrowseCache::prune()
+{
+    QDir dir(QFileInfo(path(QLatin1String("x"))).absolutePath());
+    qint64 size = 0;
+
+    Q_FOREACH(const QFileInfo &info, dir.entryInfoList(QDir::Files, QDir::Time)) {
+        size += info.size();
+        if (size > MAX_CACHE_SIZE) {
+            QFile::remove(info.absoluteFilePath());
+        }
+    }
+}
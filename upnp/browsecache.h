@@ -0,0 +1,57 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BROWSECACHE_H
+#define BROWSECACHE_H
+
+#include <QtCore/QString>
+
+#include "browsemodel_p.h"
+
+/*!
+ * \brief Persistent cache of Browse results.
+ *
+ * One file per server, container, sort order and filter. A file holds a
+ * fixed-size header, a table of fixed-size rows and resources and a blob of
+ * UTF-16 strings the tables point into, so it can be read with a single
+ * mmap().
+ */
+class BrowseCache
+{
+public:
+    struct Entry {
+        QString        systemUpdateId;
+        QString        containerUpdateId;
+        guint          totalMatches;
+        BrowseItemList items;
+    };
+
+    static QString key(const QString &udn,
+                       const QString &objectId,
+                       const QString &sortCriteria,
+                       const QString &filter);
+    static bool load(const QString &key, Entry *entry);
+    static bool store(const QString &key, const Entry &entry);
+    static void storeLater(const QString &key, const Entry &entry);
+    static void remove(const QString &key);
+
+private:
+    static QString path(const QString &key);
+    static void prune();
+};
+
+#endif // BROWSECACHE_H
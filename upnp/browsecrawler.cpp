@@ -0,0 +1,290 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <QStringList>
+
+#include "browsecrawler.h"
+#include "browseresultparser.h"
+#include "browsescheduler.h"
+#include "browseslicesizer.h"
+#include "serviceproxycall.h"
+
+const int BrowseCrawler::DEFAULT_MAX_CALLS = 3;
+
+// Answers slower than this shrink the number of calls in flight to one
+const qint64 SLOW_CALL_MS = 2000;
+
+/*!
+ * \param call Browse call with BrowseFlag BrowseDirectChildren, Filter and
+ *        SortCriteria set; ObjectID, StartingIndex and RequestedCount are
+ *        set per page. Takes ownership.
+ * \param udn UDN of the server, to share its slice size and scheduler
+ */
+BrowseCrawler::BrowseCrawler(ServiceProxyCall *call,
+                             const QString &udn,
+                             QObject *parent)
+    : QObject(parent)
+    , m_call(call)
+    , m_parser(new BrowseResultParser)
+    , m_sliceSizer(BrowseSliceSizer::forServer(udn))
+    , m_scheduler(BrowseScheduler::forServer(udn))
+    , m_queue()
+    , m_visited()
+    , m_calls()
+    , m_parses()
+    , m_nextParse(0)
+    , m_maxCalls(DEFAULT_MAX_CALLS)
+    , m_window(1)
+    , m_priority(BrowseScheduler::PriorityCrawl)
+    , m_running(false)
+    , m_items(0)
+    , m_containers(0)
+    , m_bytes(0)
+    , m_timer()
+    , m_duration(0)
+{
+    m_call->setParent(this);
+
+    connect(this, SIGNAL(parseRequested(int,uint,uint,QByteArray)),
+            m_parser, SLOT(parse(int,uint,uint,QByteArray)));
+    connect(m_parser, SIGNAL(parsed(int,uint,uint,BrowseItemList,qint64)),
+            SLOT(onParsed(int,uint,uint,BrowseItemList,qint64)));
+}
+
+BrowseCrawler::~BrowseCrawler()
+{
+    // lives in the parser thread
+    m_parser->deleteLater();
+    cancel();
+}
+
+/*!
+ * \brief Crawl the tree below objectId, cancelling a running crawl.
+ */
+void BrowseCrawler::start(const QString &objectId)
+{
+    cancel();
+
+    m_visited.clear();
+    m_visited << objectId;
+    m_queue << qMakePair(objectId, 0u);
+    m_items = 0;
+    m_containers = 1;
+    m_bytes = 0;
+    m_window = 1;
+    m_timer.start();
+    setRunning(true);
+    startCalls();
+}
+
+void BrowseCrawler::setMaxCalls(int calls)
+{
+    m_maxCalls = qMax(1, calls);
+    startCalls();
+}
+
+double BrowseCrawler::itemsPerSecond() const
+{
+    const qint64 elapsed = m_running ? m_timer.elapsed() : m_duration;
+
+    return elapsed > 0 ? m_items * 1000.0 / elapsed : 0.0;
+}
+
+double BrowseCrawler::bytesPerSecond() const
+{
+    const qint64 elapsed = m_running ? m_timer.elapsed() : m_duration;
+
+    return elapsed > 0 ? m_bytes * 1000.0 / elapsed : 0.0;
+}
+
+void BrowseCrawler::cancel()
+{
+    QList<ServiceProxyCall *> calls = m_calls;
+
+    m_calls.clear();
+    Q_FOREACH(ServiceProxyCall *call, calls) {
+        call->disconnect(this);
+        m_scheduler->cancel(call);
+        call->deleteLater();
+    }
+
+    // Results of the parser still on their way are dropped in onParsed()
+    m_parses.clear();
+    m_queue.clear();
+    setRunning(false);
+}
+
+void BrowseCrawler::startCalls()
+{
+    if (not m_running) {
+        return;
+    }
+
+    const guint sliceSize = m_sliceSizer->sliceSize();
+
+    while (m_calls.count() < qMin(m_window, m_maxCalls) && not m_queue.isEmpty()) {
+        auto page = m_queue.takeFirst();
+        auto call = m_call->clone(this);
+
+        call->setArg(QLatin1String("ObjectID"), page.first);
+        call->setArg(QLatin1String("StartingIndex"), page.second);
+        call->setArg(QLatin1String("RequestedCount"), sliceSize);
+        connect(call, SIGNAL(ready()), SLOT(onCallReady()));
+        m_calls << call;
+        m_scheduler->run(call, m_priority);
+    }
+}
+
+/*!
+ * \brief Set the priority the Browse calls run at.
+ *
+ * Applies to the calls already queued or running as well.
+ */
+void BrowseCrawler::setPriority(BrowseScheduler::Priority priority)
+{
+    m_priority = priority;
+    Q_FOREACH(ServiceProxyCall *call, m_calls) {
+        m_scheduler->setPriority(call, priority);
+    }
+}
+
+void BrowseCrawler::onCallReady()
+{
+    auto call = qobject_cast<ServiceProxyCall *>(sender());
+    if (call == 0 || call->cancelled()) {
+        return;
+    }
+
+    call->finalize(QStringList() << QLatin1String("Result")
+                                 << QLatin1String("NumberReturned")
+                                 << QLatin1String("TotalMatches"));
+    m_calls.removeOne(call);
+    call->deleteLater();
+
+    const QString id = call->arg(QLatin1String("ObjectID")).toString();
+    if (call->hasError()) {
+        // Skip the container and give the server some air
+        qDebug() << "Failed to crawl" << id << call->errorMessage();
+        m_window = 1;
+        Q_EMIT error(call->errorCode(), call->errorMessage());
+        startCalls();
+        checkFinished();
+
+        return;
+    }
+
+    guint offset = call->arg(QLatin1String("StartingIndex")).toUInt();
+    guint requested = call->arg(QLatin1String("RequestedCount")).toUInt();
+    guint numberReturned = call->get(QLatin1String("NumberReturned")).toUInt();
+    guint totalMatches = call->get(QLatin1String("TotalMatches")).toUInt();
+    const QByteArray result = call->get(QLatin1String("Result")).toString().toUtf8();
+
+    m_bytes += result.size();
+    m_sliceSizer->update(requested,
+                         numberReturned,
+                         offset + numberReturned >= totalMatches,
+                         call->elapsed(),
+                         result.size());
+
+    if (call->elapsed() > SLOW_CALL_MS) {
+        m_window = 1;
+    } else if (m_window < m_maxCalls) {
+        m_window++;
+    }
+
+    if (numberReturned > 0) {
+        // Finish a container before starting the next one to keep the
+        // queue short
+        if (offset + numberReturned < totalMatches) {
+            m_queue.prepend(qMakePair(id, offset + numberReturned));
+        }
+
+        m_parses.insert(m_nextParse, id);
+        Q_EMIT parseRequested(m_nextParse++, offset, numberReturned, result);
+    }
+
+    startCalls();
+    checkFinished();
+}
+
+void BrowseCrawler::onParsed(int generation, uint offset, uint count, const BrowseItemList &items, qint64 elapsed)
+{
+    Q_UNUSED(offset);
+    Q_UNUSED(count);
+    Q_UNUSED(elapsed);
+
+    // Cancelled meanwhile
+    if (not m_parses.contains(generation)) {
+        return;
+    }
+    m_parses.remove(generation);
+
+    BrowseItemList found;
+    Q_FOREACH(const BrowseItem &item, items) {
+        if (m_visited.contains(item.id)) {
+            continue;
+        }
+        m_visited << item.id;
+
+        if (item.container) {
+            m_queue << qMakePair(item.id, 0u);
+            m_containers++;
+        } else {
+            found << item;
+        }
+    }
+
+    m_items += found.count();
+    if (not found.isEmpty()) {
+        Q_EMIT itemsFound(found);
+    }
+    Q_EMIT progress();
+
+    startCalls();
+    checkFinished();
+}
+
+void BrowseCrawler::checkFinished()
+{
+    if (not m_running ||
+        not m_calls.isEmpty() || not m_queue.isEmpty() || not m_parses.isEmpty()) {
+        return;
+    }
+
+    m_duration = m_timer.elapsed();
+    qDebug() << "Crawled" << m_items << "items in" << m_containers << "containers in"
+             << m_duration << "ms:" << itemsPerSecond() << "items/s,"
+             << bytesPerSecond() << "bytes/s";
+
+    setRunning(false);
+    Q_EMIT finished();
+}
+
+void BrowseCrawler::setRunning(bool running)
+{
+    if (running == m_running) {
+        return;
+    }
+
+    if (not running && m_timer.isValid()) {
+        m_duration = m_timer.elapsed();
+    }
+
+    m_running = running;
+    Q_EMIT runningChanged();
+}
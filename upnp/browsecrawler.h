@@ -0,0 +1,112 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BROWSECRAWLER_H
+#define BROWSECRAWLER_H
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+
+#include "browsemodel_p.h"
+#include "browsescheduler.h"
+
+class BrowseResultParser;
+class BrowseSliceSizer;
+class ServiceProxyCall;
+
+/*!
+ * \brief Walks a container tree of a server breadth-first.
+ *
+ * Containers are browsed page by page with at most maxCalls() Browse calls
+ * in flight. The number of calls starts at one and only grows while the
+ * server answers quickly; errors and slow answers bring it back to one.
+ * Every object is only visited once, even if it appears in several
+ * containers. Items are handed out through itemsFound() as soon as a page
+ * is parsed. Calls are run through the server's BrowseScheduler, by
+ * default at the lowest priority, so crawling never slows down browsing.
+ * Consumers the user waits for, like playback, raise it with setPriority().
+ */
+class BrowseCrawler : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+public:
+    static const int DEFAULT_MAX_CALLS;
+
+    explicit BrowseCrawler(ServiceProxyCall *call,
+                           const QString &udn,
+                           QObject *parent = 0);
+    ~BrowseCrawler();
+
+    void start(const QString &objectId);
+    bool running() const { return m_running; }
+    int maxCalls() const { return m_maxCalls; }
+    void setMaxCalls(int calls);
+    BrowseScheduler::Priority priority() const { return m_priority; }
+    void setPriority(BrowseScheduler::Priority priority);
+
+    int itemCount() const { return m_items; }
+    int containerCount() const { return m_containers; }
+    double itemsPerSecond() const;
+    double bytesPerSecond() const;
+
+Q_SIGNALS:
+    void itemsFound(const BrowseItemList &items);
+    void progress();
+    void finished();
+    void error(int code, const QString &message);
+    void runningChanged();
+    void parseRequested(int generation, uint offset, uint count, const QByteArray &result);
+
+public Q_SLOTS:
+    void cancel();
+
+private Q_SLOTS:
+    void onCallReady();
+    void onParsed(int generation, uint offset, uint count, const BrowseItemList &items, qint64 elapsed);
+
+private:
+    void startCalls();
+    void checkFinished();
+    void setRunning(bool running);
+
+    ServiceProxyCall                 *m_call;
+    BrowseResultParser               *m_parser;
+    BrowseSliceSizer                 *m_sliceSizer;
+    BrowseScheduler                  *m_scheduler;
+    // container id and StartingIndex of the pages still to browse
+    QList<QPair<QString, guint> >     m_queue;
+    QSet<QString>                     m_visited;
+    QList<ServiceProxyCall *>         m_calls;
+    QHash<int, QString>               m_parses;
+    int                               m_nextParse;
+    int                               m_maxCalls;
+    int                               m_window;
+    BrowseScheduler::Priority         m_priority;
+    bool                              m_running;
+    int                               m_items;
+    int                               m_containers;
+    qint64                            m_bytes;
+    QElapsedTimer                     m_timer;
+    qint64                            m_duration;
+};
+
+#endif // BROWSECRAWLER_H
@@ -0,0 +1,308 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <iterator>
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include "browsefilter.h"
+
+const int BrowseFilter::INDEX_THRESHOLD = 2000;
+
+BrowseFilter::BrowseFilter()
+    : m_keys()
+    , m_offsets()
+    , m_includeDetails(false)
+    , m_trigrams()
+    , m_indexed(false)
+    , m_query()
+    , m_matches()
+    , m_matchList()
+{
+}
+
+/*!
+ * \brief Create the key a text is matched on.
+ *
+ * Decomposes the text, drops all combining marks and folds the case, so
+ * "Beyoncé" and "BEYONCE" both become "beyonce".
+ */
+QString BrowseFilter::normalize(const QString &text)
+{
+    const QString decomposed = text.normalized(QString::NormalizationForm_KD);
+    QString result;
+
+    result.reserve(decomposed.size());
+    for (int i = 0; i < decomposed.size(); i++) {
+        switch (decomposed.at(i).category()) {
+        case QChar::Mark_NonSpacing:
+        case QChar::Mark_SpacingCombining:
+        case QChar::Mark_Enclosing:
+            break;
+        default:
+            result += decomposed.at(i);
+            break;
+        }
+    }
+
+    return result.toCaseFolded();
+}
+
+/*!
+ * \brief Remove all rows. The query is kept.
+ */
+void BrowseFilter::clear()
+{
+    m_keys.clear();
+    m_offsets.clear();
+    m_trigrams.clear();
+    m_indexed = false;
+    m_matches.clear();
+    m_matchList.clear();
+}
+
+/*!
+ * \brief Add a row.
+ * \param titleKey normalized title of the row, see normalize()
+ * \param detailKey normalized details of the row
+ */
+void BrowseFilter::append(const QString &titleKey, const QString &detailKey)
+{
+    const int row = m_offsets.count() / 2;
+
+    m_offsets << m_keys.size();
+    m_keys += titleKey;
+    // Keeps queries from matching across title and details
+    m_keys += QLatin1Char('\n');
+    m_offsets << m_keys.size();
+    m_keys += detailKey;
+
+    m_matches.resize(row + 1);
+    if (m_indexed) {
+        indexRow(row);
+    }
+
+    if (not m_query.isEmpty()) {
+        match(row);
+    }
+}
+
+QString BrowseFilter::titleKey(int row) const
+{
+    const quint32 start = m_offsets.at(row * 2);
+
+    return m_keys.mid(start, m_offsets.at(row * 2 + 1) - 1 - start);
+}
+
+QString BrowseFilter::detailKey(int row) const
+{
+    const quint32 start = m_offsets.at(row * 2 + 1);
+    const quint32 end = row * 2 + 2 < m_offsets.count() ? m_offsets.at(row * 2 + 2) : m_keys.size();
+
+    return m_keys.mid(start, end - start);
+}
+
+/*!
+ * \brief The text a row is matched on, without copying it.
+ */
+QString BrowseFilter::key(int row) const
+{
+    const quint32 start = m_offsets.at(row * 2);
+    quint32 end;
+
+    if (m_includeDetails) {
+        end = row * 2 + 2 < m_offsets.count() ? m_offsets.at(row * 2 + 2) : m_keys.size();
+    } else {
+        end = m_offsets.at(row * 2 + 1) - 1;
+    }
+
+    return QString::fromRawData(m_keys.constData() + start, end - start);
+}
+
+/*!
+ * \brief Choose whether the details of a row are searched as well.
+ */
+void BrowseFilter::setIncludeDetails(bool includeDetails)
+{
+    if (includeDetails == m_includeDetails) {
+        return;
+    }
+
+    m_includeDetails = includeDetails;
+    m_trigrams.clear();
+    m_indexed = false;
+    rematch();
+}
+
+void BrowseFilter::rematch()
+{
+    const int rows = m_offsets.count() / 2;
+
+    m_matches.fill(false, rows);
+    m_matchList.clear();
+    if (m_query.isEmpty()) {
+        return;
+    }
+
+    for (int row = 0; row < rows; row++) {
+        match(row);
+    }
+}
+
+qint64 BrowseFilter::memoryUsage() const
+{
+    qint64 size = m_keys.capacity() * sizeof(QChar) +
+                  m_offsets.capacity() * sizeof(quint32) +
+                  m_matches.size() / 8 +
+                  m_matchList.capacity() * sizeof(int);
+
+    QHashIterator<quint64, QVector<int> > it(m_trigrams);
+    while (it.hasNext()) {
+        it.next();
+        size += sizeof(quint64) + it.value().capacity() * sizeof(int);
+    }
+
+    return size;
+}
+
+/*!
+ * \brief Change the text rows are filtered for.
+ * \param query text as entered by the user, an empty query accepts all rows
+ */
+void BrowseFilter::setQuery(const QString &query)
+{
+    const QString normalized = normalize(query);
+    QVector<int> candidates;
+    bool all = false;
+
+    if (normalized == m_query) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (not m_query.isEmpty() && normalized.contains(m_query)) {
+        // Only rows matching the previous query can match this one
+        candidates = m_matchList;
+    } else if (normalized.size() >= 3 && m_offsets.count() / 2 >= INDEX_THRESHOLD) {
+        if (not m_indexed) {
+            buildIndex();
+        }
+        candidates = indexCandidates(normalized);
+    } else {
+        all = true;
+    }
+
+    m_query = normalized;
+    if (all) {
+        rematch();
+    } else {
+        m_matches.fill(false, m_offsets.count() / 2);
+        m_matchList.clear();
+        Q_FOREACH(int row, candidates) {
+            match(row);
+        }
+    }
+
+    qDebug() << "Filtered" << m_offsets.count() / 2 << "rows to" << m_matchList.count()
+             << "checking" << (all ? m_offsets.count() / 2 : candidates.count())
+             << "in" << timer.elapsed() << "ms";
+}
+
+bool BrowseFilter::accepts(int row) const
+{
+    if (m_query.isEmpty()) {
+        return true;
+    }
+
+    return row < m_matches.size() && m_matches.testBit(row);
+}
+
+quint64 BrowseFilter::trigram(const QChar *chars)
+{
+    return (quint64(chars[0].unicode()) << 32) |
+           (quint64(chars[1].unicode()) << 16) |
+            quint64(chars[2].unicode());
+}
+
+void BrowseFilter::buildIndex()
+{
+    m_trigrams.clear();
+    for (int row = 0; row < m_offsets.count() / 2; row++) {
+        indexRow(row);
+    }
+    m_indexed = true;
+}
+
+void BrowseFilter::indexRow(int row)
+{
+    const QString text = key(row);
+
+    for (int i = 0; i + 3 <= text.size(); i++) {
+        QVector<int> &rows = m_trigrams[trigram(text.constData() + i)];
+
+        // A trigram can occur more than once in a key
+        if (rows.isEmpty() || rows.last() != row) {
+            rows << row;
+        }
+    }
+}
+
+static bool shorterThan(const QVector<int> *a, const QVector<int> *b)
+{
+    return a->count() < b->count();
+}
+
+/*!
+ * \brief Rows containing all trigrams of query, in ascending order.
+ */
+QVector<int> BrowseFilter::indexCandidates(const QString &query) const
+{
+    QList<const QVector<int> *> lists;
+
+    for (int i = 0; i + 3 <= query.size(); i++) {
+        auto it = m_trigrams.constFind(trigram(query.constData() + i));
+        if (it == m_trigrams.constEnd()) {
+            return QVector<int>();
+        }
+        lists << &it.value();
+    }
+
+    // Intersect starting with the shortest posting list
+    std::sort(lists.begin(), lists.end(), shorterThan);
+    QVector<int> result = *lists.first();
+    for (int i = 1; i < lists.count() && not result.isEmpty(); i++) {
+        QVector<int> intersection;
+        std::set_intersection(result.constBegin(), result.constEnd(),
+                              lists.at(i)->constBegin(), lists.at(i)->constEnd(),
+                              std::back_inserter(intersection));
+        result = intersection;
+    }
+
+    return result;
+}
+
+void BrowseFilter::match(int row)
+{
+    if (key(row).contains(m_query)) {
+        m_matches.setBit(row);
+        m_matchList << row;
+    }
+}
@@ -0,0 +1,77 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BROWSEFILTER_H
+#define BROWSEFILTER_H
+
+#include <QtCore/QBitArray>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+/*!
+ * \brief Substring filter over the rows of a BrowseModel.
+ *
+ * Rows are matched on keys that are case-folded and stripped of accents
+ * with normalize(). The keys of all rows share one string. A query that
+ * contains the previous one only re-checks the previous matches.
+ * Containers with more than INDEX_THRESHOLD rows get a trigram index which
+ * narrows down the rows to check for queries of three or more characters.
+ */
+class BrowseFilter
+{
+public:
+    static const int INDEX_THRESHOLD;
+
+    static QString normalize(const QString &text);
+
+    BrowseFilter();
+
+    void clear();
+    void append(const QString &titleKey, const QString &detailKey);
+    void setQuery(const QString &query);
+    QString query() const { return m_query; }
+    void setIncludeDetails(bool includeDetails);
+    bool accepts(int row) const;
+
+    QString titleKey(int row) const;
+    QString detailKey(int row) const;
+    qint64 memoryUsage() const;
+
+private:
+    static quint64 trigram(const QChar *chars);
+
+    QString key(int row) const;
+    void buildIndex();
+    void indexRow(int row);
+    QVector<int> indexCandidates(const QString &query) const;
+    void match(int row);
+    void rematch();
+
+    // title key, '\n', detail key of each row; m_offsets holds the start of
+    // the title and of the detail key per row plus the end of the last row
+    QString                       m_keys;
+    QVector<quint32>              m_offsets;
+    bool                          m_includeDetails;
+    QHash<quint64, QVector<int> > m_trigrams;
+    bool                          m_indexed;
+    QString                       m_query;
+    QBitArray                     m_matches;
+    QVector<int>                  m_matchList;
+};
+
+#endif // BROWSEFILTER_H
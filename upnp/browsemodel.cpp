@@ -23,31 +23,51 @@ along with Helium.  If not, see <http://www.gnu.org/licenses/>.
 
 static BrowseModel* g_empty;
 
-BrowseModel::BrowseModel(ServiceProxyCall *call, const QString &protocolInfo, QObject *parent)
+BrowseModel::BrowseModel(ServiceProxyCall *call, const QString &protocolInfo, const QString &udn, QObject *parent)
     : QSortFilterProxyModel(parent)
-    , d_ptr(new BrowseModelPrivate(call, protocolInfo, this))
+    , d_ptr(new BrowseModelPrivate(call, protocolInfo, udn, this))
 {
     Q_D(BrowseModel);
     setSourceModel(d);
-    setFilterRole(d->m_settings.filterInDetails() ? BrowseModelPrivate::BrowseRoleFilter : BrowseModelPrivate::BrowseRoleTitle);
-    setFilterCaseSensitivity(Qt::CaseInsensitive);
 
     connect(d, SIGNAL(busyChanged()), SIGNAL(busyChanged()));
     connect(d, SIGNAL(doneChanged()), SIGNAL(doneChanged()));
     connect(d, SIGNAL(error(int,QString)), SIGNAL(error(int,QString)));
     connect(d, SIGNAL(lastIndexChanged()), SIGNAL(lastIndexChanged()));
     connect(d, SIGNAL(protocolInfoChanged()), SIGNAL(protocolInfoChanged()));
+    connect(d, SIGNAL(lazyChanged()), SIGNAL(lazyChanged()));
 }
 
 BrowseModel &BrowseModel::empty()
 {
     if (g_empty == 0) {
-        g_empty = new BrowseModel(0, QLatin1String("*:*:*:*"), qApp);
+        g_empty = new BrowseModel(0, QLatin1String("*:*:*:*"), QString(), qApp);
     }
 
     return *g_empty;
 }
 
+/*!
+ * \brief The Browse Filter asking only for what a set of roles needs.
+ *
+ * Properties every ContentDirectory returns are always included.
+ *
+ * \param roles role names as bound in QML, e.g. "title" or "icon"
+ */
+QString BrowseModel::filterForRoles(const QStringList &roles)
+{
+    return BrowseModelPrivate::filterForRoles(roles);
+}
+
+/*!
+ * \brief The Browse Filter asking for all properties the roles and the
+ *        local sort use.
+ */
+QString BrowseModel::completeFilter()
+{
+    return BrowseModelPrivate::completeFilter();
+}
+
 void BrowseModel::refresh()
 {
     Q_D(BrowseModel);
@@ -55,6 +75,165 @@ void BrowseModel::refresh()
     d->refresh();
 }
 
+/*!
+ * \brief Tell the model which row the view has reached.
+ *
+ * In lazy mode, the model then fetches the slices up to this row plus a
+ * lookahead window.
+ *
+ * \param row last visible row of the view
+ */
+void BrowseModel::fetchUpTo(int row)
+{
+    Q_D(BrowseModel);
+
+    QModelIndex sourceIndex = mapToSource(index(row, 0));
+    d->fetchUpTo(sourceIndex.isValid() ? sourceIndex.row() : d->rowCount());
+}
+
+/*!
+ * \brief Enable the on-disk cache for this model.
+ *
+ * Has to be called before the first refresh().
+ *
+ * \param key as returned by BrowseCache::key()
+ * \param systemUpdateId current SystemUpdateID of the server, if known
+ * \param containerUpdateId current update id of the container, if known
+ */
+void BrowseModel::setCache(const QString &key,
+                           const QString &systemUpdateId,
+                           const QString &containerUpdateId)
+{
+    Q_D(BrowseModel);
+
+    d->setCache(key, systemUpdateId, containerUpdateId);
+}
+
+bool BrowseModel::isCurrent(const QString &systemUpdateId,
+                            const QString &containerUpdateId) const
+{
+    Q_D(const BrowseModel);
+
+    return d->isCurrent(systemUpdateId, containerUpdateId);
+}
+
+qint64 BrowseModel::memoryUsage() const
+{
+    Q_D(const BrowseModel);
+
+    return d->memoryUsage();
+}
+
+/*!
+ * \brief Enable fetching properties the Browse Filter left out.
+ *
+ * When a role is read whose properties the Filter of the model's call did
+ * not ask for, the row is fetched again with a copy of call and updated.
+ *
+ * \param call BrowseMetadata call with a complete Filter; the ObjectID is
+ *        set per row. The model takes ownership.
+ */
+void BrowseModel::setMetaDataCall(ServiceProxyCall *call)
+{
+    Q_D(BrowseModel);
+
+    d->setMetaDataCall(call);
+}
+
+/*!
+ * \brief Sort the rows on the device instead of relying on the server.
+ *
+ * For servers whose SortCapabilities lack the properties of the sort
+ * criteria. Has to be called before the first refresh(). Rows are sorted
+ * on a worker thread; a lazy model is reordered whenever rows were added,
+ * other models once all rows are there.
+ *
+ * \param sort the order to sort rows in
+ */
+void BrowseModel::setLocalSort(LocalSort sort)
+{
+    Q_D(BrowseModel);
+
+    d->setLocalSort(sort);
+}
+
+/*!
+ * \brief Tell the model whether it is the one the user is looking at.
+ *
+ * The remaining Browse calls of models in the background only run while
+ * the server has nothing to do for the model on screen.
+ */
+void BrowseModel::setForeground(bool foreground)
+{
+    Q_D(BrowseModel);
+
+    d->setForeground(foreground);
+}
+
+/*!
+ * \brief Cancel all Browse calls of the model right away.
+ *
+ * The rows loaded so far are kept. resume() continues loading where the
+ * model stopped.
+ */
+void BrowseModel::suspend()
+{
+    Q_D(BrowseModel);
+
+    d->suspend();
+}
+
+void BrowseModel::resume()
+{
+    Q_D(BrowseModel);
+
+    d->resume();
+}
+
+QString BrowseModel::udn() const
+{
+    Q_D(const BrowseModel);
+
+    return d->udn();
+}
+
+QString BrowseModel::objectId() const
+{
+    Q_D(const BrowseModel);
+
+    return d->objectId();
+}
+
+QString BrowseModel::browseFilter() const
+{
+    Q_D(const BrowseModel);
+
+    return d->browseFilter();
+}
+
+/*!
+ * \brief Only show rows containing text.
+ *
+ * Case and accents are ignored. Which roles are searched depends on the
+ * filterInDetails setting.
+ *
+ * \param text the text to search for, empty to show all rows
+ */
+void BrowseModel::setFilterText(const QString &text)
+{
+    Q_D(BrowseModel);
+
+    d->setFilterText(text);
+    invalidateFilter();
+}
+
+bool BrowseModel::filterAcceptsRow(int source_row, const QModelIndex &/*source_parent*/) const
+{
+    Q_D(const BrowseModel);
+
+    return d->filterAcceptsRow(source_row);
+}
+
 QString BrowseModel::protocolInfo() const
 {
     Q_D(const BrowseModel);
@@ -96,3 +275,34 @@ bool BrowseModel::busy() const
 
     return d->busy();
 }
+
+bool BrowseModel::lazy() const
+{
+    Q_D(const BrowseModel);
+
+    return d->lazy();
+}
+
+/*!
+ * \brief The text a search model was created for, empty for Browse models.
+ */
+QString BrowseModel::searchText() const
+{
+    Q_D(const BrowseModel);
+
+    return d->searchText();
+}
+
+void BrowseModel::setSearchText(const QString &text)
+{
+    Q_D(BrowseModel);
+
+    d->setSearchText(text);
+}
+
+void BrowseModel::setLazy(bool lazy)
+{
+    Q_D(BrowseModel);
+
+    d->setLazy(lazy);
+}
@@ -29,23 +29,54 @@ class BrowseModel : public QSortFilterProxyModel
     Q_PROPERTY(bool done READ done NOTIFY doneChanged)
     Q_PROPERTY(QString protocolInfo READ protocolInfo WRITE setProtocolInfo NOTIFY protocolInfoChanged)
     Q_PROPERTY(int lastIndex READ lastIndex WRITE setLastIndex NOTIFY lastIndexChanged)
+    Q_PROPERTY(bool lazy READ lazy WRITE setLazy NOTIFY lazyChanged)
+    Q_PROPERTY(QString searchText READ searchText CONSTANT)
 public:
+    enum LocalSort {
+        SortNone,
+        SortByClassAndTitle,
+        SortByTrackAndTitle
+    };
+
     explicit BrowseModel(ServiceProxyCall *call = 0,
                          const QString &protocolInfo = QLatin1String("*:*:*:*"),
+                         const QString &udn = QString(),
                          QObject       *parent = 0);
 
     static BrowseModel &empty();
+    static QString filterForRoles(const QStringList &roles);
+    static QString completeFilter();
     Q_INVOKABLE void refresh();
+    Q_INVOKABLE void fetchUpTo(int row);
+    Q_INVOKABLE void setFilterText(const QString &text);
+    void setCache(const QString &key,
+                  const QString &systemUpdateId,
+                  const QString &containerUpdateId);
+    bool isCurrent(const QString &systemUpdateId,
+                   const QString &containerUpdateId) const;
+    qint64 memoryUsage() const;
+    void setMetaDataCall(ServiceProxyCall *call);
+    void setLocalSort(LocalSort sort);
+    void setForeground(bool foreground);
+    void suspend();
+    void resume();
+    QString udn() const;
+    QString objectId() const;
+    QString browseFilter() const;
 
     // property getters
     bool busy() const;
     bool done() const;
     QString protocolInfo() const;
     int lastIndex() const;
+    bool lazy() const;
+    QString searchText() const;
 
     // property setters
     void setProtocolInfo(const QString &protocolInfo);
     void setLastIndex(int index);
+    void setLazy(bool lazy);
+    void setSearchText(const QString &text);
 
 Q_SIGNALS:
     // property signals
@@ -53,13 +84,18 @@ Q_SIGNALS:
     void doneChanged();
     void protocolInfoChanged();
     void lastIndexChanged();
+    void lazyChanged();
 
     void error(int code, const QString &message);
 
 public Q_SLOTS:
+protected:
+    bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const;
+
 private:
     BrowseModelPrivate * const d_ptr;
     Q_DECLARE_PRIVATE(BrowseModel)
+    friend class BrowseModelPrivate;
 };
 
 #endif // BROWSEMODEL_H
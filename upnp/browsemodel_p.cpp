@@ -23,10 +23,15 @@ along with Helium.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "browsemodel.h"
 #include "browsemodel_p.h"
+#include "browsecache.h"
+#include "browseresultparser.h"
+#include "browsescheduler.h"
+#include "browseslicesizer.h"
+#include "browsesorter.h"
 #include "upnpdevicemodel.h"
 #include "glib-utils.h"
 #include "serviceproxycall.h"
-#include "didlliteparser.h"
+#include "thumbnailprovider.h"
 
 const char AUDIO_PREFIX[] = "object.item.audioItem";
 const char IMAGE_PREFIX[] = "object.item.imageItem";
@@ -36,16 +41,139 @@ const char ARTIST_CLASS[] = "object.container.person.musicArtist";
 const char GENRE_CLASS[] = "object.container.genre.musicGenre";
 const char CONTAINER_PREFIX[] = "object.container";
 
+// Number of rows to keep loaded beyond the last visible row in lazy mode
+const guint LAZY_LOOKAHEAD = 200;
+
+const int BrowseModelPrivate::PAGE_SIZE = 100;
+const int BrowseModelPrivate::MAX_METADATA_CALLS = 2;
+
+// Rows waiting for a BrowseMetadata call; the oldest are dropped
+const int MAX_METADATA_QUEUE = 32;
+
+// Properties a ContentDirectory always returns, whatever the Filter says
+const char BASE_FILTER[] = "@id,dc:title,upnp:class";
+
+// Properties the roles are derived from, in addition to BASE_FILTER
+static const struct {
+    int role;
+    const char *name;
+    const char *properties;
+} ROLE_PROPERTIES[] = {
+    { BrowseModelPrivate::BrowseRoleIcon, "icon", "upnp:albumArtURI,res" },
+    { BrowseModelPrivate::BrowseRoleURI, "uri", "res" },
+    { BrowseModelPrivate::BrowseRoleDetail, "detail", "upnp:artist,upnp:album,res@duration,res@resolution,res@size" },
+    { BrowseModelPrivate::BrowseRoleMetaData, "metadata", "res" },
+    { BrowseModelPrivate::BrowseRoleFilter, "filter", "upnp:artist,upnp:album,res@duration,res@resolution,res@size" },
+    { 0, 0, 0 }
+};
+
+/*!
+ * \brief Roles whose properties a Browse Filter does not ask for.
+ */
+static QSet<int> rolesMissingFrom(const QString &filter)
+{
+    const QStringList requested = filter.split(QLatin1Char(','), QString::SkipEmptyParts);
+    QSet<int> roles;
+
+    if (requested.contains(QLatin1String("*"))) {
+        return roles;
+    }
+
+    // Asking for any attribute of res returns the res element as well
+    bool hasResource = false;
+    Q_FOREACH(const QString &property, requested) {
+        hasResource = hasResource || property == QLatin1String("res") ||
+                      property.startsWith(QLatin1String("res@"));
+    }
+
+    for (int i = 0; ROLE_PROPERTIES[i].name != 0; i++) {
+        const QStringList properties = QString::fromLatin1(ROLE_PROPERTIES[i].properties).split(QLatin1Char(','));
+
+        Q_FOREACH(const QString &property, properties) {
+            if (not requested.contains(property) &&
+                not (property == QLatin1String("res") && hasResource)) {
+                roles << ROLE_PROPERTIES[i].role;
+                break;
+            }
+        }
+    }
+
+    return roles;
+}
+
 BrowseModelPrivate::BrowseModelPrivate(ServiceProxyCall *call,
                                        const QString  &protocolInfo,
+                                       const QString  &udn,
                                        BrowseModel *parent)
     : QAbstractListModel(parent)
+    , m_pool()
+    , m_pages()
+    , m_rowCount(0)
+    , m_loadedRows(0)
+    , m_windowed(false)
+    , m_rowBudget(0)
+    , m_viewRow(0)
+    , m_fetchingPages()
+    , m_filter()
+    , m_filterStale(false)
+    , m_pendingSlices()
+    , m_missingSlices()
+    , m_sliceCalls()
+    , m_queuedRows()
+    , m_changedFirst(-1)
+    , m_changedLast(-1)
+    , m_flushTimer()
+    , m_queuedUpdates(0)
+    , m_flushedRows(0)
+    , m_flushes(0)
     , m_currentOffset(0)
+    , m_nextOffset(0)
+    , m_totalMatches(0)
+    , m_totalUnknown(false)
+    , m_fetchLimit(0)
+    , m_lazy(true)
+    , m_maxSliceCalls(1)
+    , m_parser(new BrowseResultParser)
+    , m_generation(0)
+    , m_pendingParses(0)
+    , m_parseTime(0)
     , m_busy(true)
     , m_done(false)
     , m_protocolInfo(protocolInfo)
+    , m_matcher(protocolInfo)
+    , m_uriGeneration(1)
+    , m_resolvedFirst(-1)
+    , m_resolvedLast(-1)
     , m_lastIndex(-1)
+    , m_udn(udn)
+    , m_searchText()
+    , m_cacheKey()
+    , m_systemUpdateId()
+    , m_containerUpdateId()
+    , m_updateId()
+    , m_cachedUpdateId()
+    , m_cachedTotalMatches(0)
+    , m_replaceRows(false)
+    , m_cacheDirty(false)
     , m_call(call)
+    , m_callRunning(false)
+    , m_scheduler(udn.isEmpty() ? 0 : BrowseScheduler::forServer(udn))
+    , m_foreground(true)
+    , m_suspended(false)
+    , m_missingRoles()
+    , m_metaDataCall(0)
+    , m_metaDataCalls()
+    , m_metaDataQueue()
+    , m_metaDataTimer()
+    , m_thumbnailRows()
+    , m_sorter(new BrowseSorter)
+    , m_sortMode(BrowseModel::SortNone)
+    , m_sortGeneration(0)
+    , m_pendingSorts(0)
+    , m_order()
+    , m_position()
+    , m_sortedOrder()
+    , m_sliceSizer(udn.isEmpty() ? 0 : BrowseSliceSizer::forServer(udn))
     , m_settings()
     , q_ptr(parent)
 {
@@ -66,76 +194,88 @@ BrowseModelPrivate::BrowseModelPrivate(ServiceProxyCall *call,
     if (m_call != 0) {
         connect(m_call, SIGNAL(ready()), SLOT(onCallReady()));
         m_call->setParent(this);
+        m_missingRoles = rolesMissingFrom(m_call->arg(QLatin1String("Filter")).toString());
     }
 
+    m_flushTimer.setSingleShot(true);
+    connect(&m_flushTimer, SIGNAL(timeout()), SLOT(flushRows()));
+    m_metaDataTimer.setSingleShot(true);
+    m_metaDataTimer.setInterval(0);
+    connect(&m_metaDataTimer, SIGNAL(timeout()), SLOT(startMetaDataCalls()));
+
+    m_filter.setIncludeDetails(m_settings.filterInDetails());
     connect(&m_settings, SIGNAL(filterInDetailsChanged()), SLOT(onFilterInDetailsChanged()));
+
+    connect(this, SIGNAL(parseRequested(int,uint,uint,QByteArray)),
+            m_parser, SLOT(parse(int,uint,uint,QByteArray)));
+    connect(m_parser, SIGNAL(parsed(int,uint,uint,BrowseItemList,qint64)),
+            SLOT(onSliceParsed(int,uint,uint,BrowseItemList,qint64)));
+    connect(this, SIGNAL(sortRequested(int,int,int,QStringList,QStringList,QVector<int>)),
+            m_sorter, SLOT(sort(int,int,int,QStringList,QStringList,QVector<int>)));
+    connect(m_sorter, SIGNAL(sorted(int,QVector<int>,qint64)),
+            SLOT(onRowsSorted(int,QVector<int>,qint64)));
 }
 
 BrowseModelPrivate::~BrowseModelPrivate()
 {
+    // live in the parser and sorter threads
+    m_parser->deleteLater();
+    m_sorter->deleteLater();
+    cancelSlices();
+    cancelMetaDataCalls();
+    qDeleteAll(m_pages);
+
     if (m_call != 0) {
-        m_call->cancel();
+        cancelCall(m_call);
     }
 }
 
 int BrowseModelPrivate::rowCount(const QModelIndex &/*parent*/) const
 {
-    return m_data.count();
+    return m_rowCount;
 }
 
-static QUrl findIconForObject(GUPnPDIDLLiteObject *object)
+static QUrl findIconForItem(const BrowseItem &item)
 {
     QUrl thumbnail;
-    GList* resources = gupnp_didl_lite_object_get_resources(object);
-    GList* it = resources;
-
-    const char *upnp_class = gupnp_didl_lite_object_get_upnp_class (object);
 
-    if (upnp_class == 0) {
+    if (item.upnpClass.isEmpty()) {
         thumbnail.setUrl(QLatin1String("image://theme/icon-m-content-file-unknown-inverse"));
 
         return thumbnail;
     }
 
-    if (strncmp(upnp_class, AUDIO_PREFIX, sizeof(AUDIO_PREFIX) - 1) == 0 ||
-        strncmp(upnp_class, MUSIC_ALBUM_CLASS, sizeof(MUSIC_ALBUM_CLASS) - 1) == 0) {
-        const char *album_art_uri = gupnp_didl_lite_object_get_album_art(object);
-        thumbnail.setUrl(QString::fromUtf8(album_art_uri));
+    if (item.upnpClass.startsWith(QLatin1String(AUDIO_PREFIX)) ||
+        item.upnpClass.startsWith(QLatin1String(MUSIC_ALBUM_CLASS))) {
+        thumbnail.setUrl(item.albumArtUri);
     } else {
-        while (it) {
-            GUPnPDIDLLiteResource *res = (GUPnPDIDLLiteResource*) it->data;
-            GUPnPProtocolInfo *info = gupnp_didl_lite_resource_get_protocol_info(res);
-            const char *profile = gupnp_protocol_info_get_dlna_profile(info);
-            if (profile != 0 &&
-                (strncmp(profile, "JPEG_TN", 7) == 0 ||
-                 strncmp(profile, "PNG_TN", 6) == 0)) {
-                thumbnail.setUrl(QString::fromUtf8(gupnp_didl_lite_resource_get_uri(res)));
+        Q_FOREACH(const BrowseResource &res, item.resources) {
+            if (res.protocolInfo.contains(QLatin1String("DLNA.ORG_PN=JPEG_TN")) ||
+                res.protocolInfo.contains(QLatin1String("DLNA.ORG_PN=PNG_TN"))) {
+                thumbnail.setUrl(res.uri);
                 break;
             }
-            it = it->next;
         }
     }
 
     if (thumbnail.isEmpty()) {
-        if (strncmp(upnp_class, IMAGE_PREFIX, sizeof(IMAGE_PREFIX) - 1) == 0) {
+        if (item.upnpClass.startsWith(QLatin1String(IMAGE_PREFIX))) {
             thumbnail.setUrl(QLatin1String("image://theme/icon-m-content-image-inverse"));
-        } else if (strncmp(upnp_class, VIDEO_PREFIX, sizeof(VIDEO_PREFIX) - 1) == 0) {
+        } else if (item.upnpClass.startsWith(QLatin1String(VIDEO_PREFIX))) {
             thumbnail.setUrl(QLatin1String("image://theme/icon-m-content-videos-inverse"));
-        } else if (strncmp(upnp_class, AUDIO_PREFIX, sizeof(AUDIO_PREFIX) - 1) == 0) {
+        } else if (item.upnpClass.startsWith(QLatin1String(AUDIO_PREFIX))) {
             thumbnail.setUrl(QLatin1String("image://theme/icon-m-content-audio-inverse"));
-        } else if (strncmp(upnp_class, MUSIC_ALBUM_CLASS, sizeof(MUSIC_ALBUM_CLASS) - 1) == 0) {
+        } else if (item.upnpClass.startsWith(QLatin1String(MUSIC_ALBUM_CLASS))) {
             thumbnail.setUrl(QLatin1String("image://theme/icon-m-content-album-inverse"));
-        } else if (strncmp(upnp_class, ARTIST_CLASS, sizeof(ARTIST_CLASS) - 1) == 0) {
+        } else if (item.upnpClass.startsWith(QLatin1String(ARTIST_CLASS))) {
             thumbnail.setUrl(QLatin1String("image://theme/icon-m-content-artist-inverse"));
-        } else if (strncmp(upnp_class, GENRE_CLASS, sizeof(GENRE_CLASS) - 1) == 0) {
+        } else if (item.upnpClass.startsWith(QLatin1String(GENRE_CLASS))) {
             thumbnail.setUrl(QLatin1String("image://theme/icon-m-content-genre-inverse"));
-        } else if (strncmp(upnp_class, CONTAINER_PREFIX, sizeof(CONTAINER_PREFIX) - 1) == 0) {
+        } else if (item.upnpClass.startsWith(QLatin1String(CONTAINER_PREFIX))) {
             thumbnail.setUrl(QLatin1String("image://theme/icon-m-toolbar-directory-white"));
         }
     }
 
-    g_list_free_full(resources, g_object_unref);
-
     if (thumbnail.isEmpty()) {
         thumbnail.setUrl(QLatin1String("image://theme/icon-m-content-file-unknown-inverse"));
     }
@@ -185,193 +325,419 @@ static QString formatSize(quint64 size)
     return result;
 }
 
-static QString createDetailsForObject(GUPnPDIDLLiteObject *object)
+static QString createDetailsForItem(const BrowseItem &item)
 {
     QString result;
 
-    if (GUPNP_IS_DIDL_LITE_CONTAINER(object)) {
+    if (item.container) {
         return result;
     }
 
-    GList* resources = gupnp_didl_lite_object_get_resources(object);
-    GList* it = resources;
-
-    const char *author = gupnp_didl_lite_object_get_artist(object);
-    const char *album = gupnp_didl_lite_object_get_album(object);
-
-    if (author != 0) {
-        result += QString::fromLatin1("%1").arg(QString::fromUtf8(author));
+    if (not item.artist.isEmpty()) {
+        result += item.artist;
     }
 
-    if (album != 0) {
+    if (not item.album.isEmpty()) {
         if (not result.isEmpty()) {
             result += QLatin1String(" | ");
         }
-        result += QString::fromLatin1("%1").arg(QString::fromUtf8(album));
+        result += item.album;
     }
 
     const QLatin1String empty = QLatin1String(" ");
-    while (it) {
-        GUPnPDIDLLiteResource *res = (GUPnPDIDLLiteResource*) it->data;
-        GUPnPProtocolInfo *info = gupnp_didl_lite_resource_get_protocol_info(res);
+    Q_FOREACH(const BrowseResource &res, item.resources) {
         // use first non-transcoded uri; might be problematic
-        if (gupnp_protocol_info_get_dlna_conversion (info) == GUPNP_DLNA_CONVERSION_NONE) {
-            long duration = gupnp_didl_lite_resource_get_duration(res);
-            if (duration > 0) {
-                if (not result.isEmpty()) {
-                    result += empty;
-                }
-                result += formatTime(duration);
+        if (res.protocolInfo.contains(QLatin1String("DLNA.ORG_CI=1"))) {
+            continue;
+        }
 
+        if (res.duration > 0) {
+            if (not result.isEmpty()) {
+                result += empty;
             }
+            result += formatTime(res.duration);
+        }
 
-            int width = gupnp_didl_lite_resource_get_width(res);
-            int height = gupnp_didl_lite_resource_get_height(res);
-            if (width > 0 && height > 0) {
-                if (not result.isEmpty()) {
-                    result += empty;
-                }
-                result += QString::fromLatin1("%1x%2").arg(QString::number(width), QString::number(height));
+        if (res.width > 0 && res.height > 0) {
+            if (not result.isEmpty()) {
+                result += empty;
             }
+            result += QString::fromLatin1("%1x%2").arg(QString::number(res.width), QString::number(res.height));
+        }
 
-            gint64 size = gupnp_didl_lite_resource_get_size64(res);
-            if (size > 0) {
-                if (not result.isEmpty()) {
-                    result += empty;
-                }
-
-                result += formatSize(size);
+        if (res.size > 0) {
+            if (not result.isEmpty()) {
+                result += empty;
             }
 
-            break;
+            result += formatSize(res.size);
         }
-        it = it->next;
-    }
 
-    g_list_free_full(resources, g_object_unref);
+        break;
+    }
 
     return result;
 }
 
-QString BrowseModelPrivate::getCompatibleUri(int index, const QString &protocolInfo) const
+// Resources on a host given by IP address are preferred; renderers often
+// can not resolve the names servers use
+static bool hasAddressHost(const QString &uri)
+{
+    QUrl url(uri);
+
+    return not url.host().isEmpty() && not QHostAddress(url.host()).isNull();
+}
+
+/*!
+ * \brief Find a resource of the row the renderer can play.
+ *
+ * The index of the resource is memoized per row until the protocolInfo
+ * changes.
+ */
+QString BrowseModelPrivate::getCompatibleUri(int index) const
 {
-    RefPtrG<GUPnPDIDLLiteResource> resource;
-    DIDLLiteObject object = m_data.at(index);
-    QString urlString;
+    const quint32 NO_RESOURCE = 0xffff;
+    const BrowsePage *p = page(index);
+    const int row = index % PAGE_SIZE;
 
-    if (object.isEmpty()) {
+    if (p == 0) {
         return QString();
     }
 
-    // work-around GNOME bug 671246
-    QStringList protocolInfoList = protocolInfo.split(QLatin1Char(','));
-    while (protocolInfoList.size() > 0) {
-        int split = MIN(255, protocolInfoList.size());
-        QString protocolInfoStrip = QStringList(protocolInfoList.mid(0, split)).join(QLatin1String(","));
-        protocolInfoList = protocolInfoList.mid(split);
+    if (p->uris.count() < p->rows.count()) {
+        p->uris.resize(p->rows.count());
+    }
 
-        resource = wrap(gupnp_didl_lite_object_get_compat_resource(object,
-                                                                   protocolInfoStrip.toUtf8().constData(),
-                                                                   FALSE));
-        if (not resource.isEmpty()) {
-            urlString = QString::fromUtf8(gupnp_didl_lite_resource_get_uri(resource));
-            QUrl url(urlString);
+    const quint32 memo = p->uris.at(row);
+    if (memo >> 16 == m_uriGeneration) {
+        const quint32 resource = memo & 0xffff;
 
-            // check that uri has a host and that the host is an IP address
-            if (not (url.host().isEmpty()) &&
-                not QHostAddress(url.host()).isNull()) {
-                break;
-            }
+        return resource == NO_RESOURCE ? QString() : p->rows.resourceUri(row, resource);
+    }
+
+    quint32 compatible = NO_RESOURCE;
+    for (int i = 0; i < p->rows.resourceCount(row) && i < int(NO_RESOURCE); i++) {
+        if (not m_matcher.isCompatible(p->rows.resourceProtocolInfo(row, i))) {
+            continue;
+        }
+
+        if (hasAddressHost(p->rows.resourceUri(row, i))) {
+            compatible = i;
+            break;
+        }
+
+        if (compatible == NO_RESOURCE) {
+            compatible = i;
         }
     }
 
-    if (resource.isEmpty()) {
-        return QString();
+    p->uris[row] = quint32(m_uriGeneration) << 16 | compatible;
+
+    // Remember which rows have to be updated if the protocolInfo changes
+    if (m_resolvedFirst < 0 || index < m_resolvedFirst) {
+        m_resolvedFirst = index;
     }
+    m_resolvedLast = qMax(m_resolvedLast, index);
 
-    return urlString;
+    return compatible == NO_RESOURCE ? QString() : p->rows.resourceUri(row, compatible);
 }
 
-static QString generateMetaData(GUPnPDIDLLiteObject *object)
+static QString generateMetaData(const BrowseItem &item)
 {
-    GList *resources, *it;
-
-    if (GUPNP_IS_DIDL_LITE_CONTAINER(object)) {
+    if (item.container) {
         return QString();
     }
 
     // produce minimal DIDL
     auto writer = wrap(gupnp_didl_lite_writer_new (NULL));
-    GUPnPDIDLLiteObject *item = GUPNP_DIDL_LITE_OBJECT(gupnp_didl_lite_writer_add_item(writer));
-    const char *title = gupnp_didl_lite_object_get_title(object);
+    GUPnPDIDLLiteObject *object = GUPNP_DIDL_LITE_OBJECT(gupnp_didl_lite_writer_add_item(writer));
+    QByteArray title = item.title.toUtf8();
 
     // maximum title length is 256 bytes
-    if (strlen(title) > 256) {
-        char *tmp = 0;
+    if (title.size() > 256) {
         const char *end_ptr = 0;
 
-        g_utf8_validate(title, 256, &end_ptr);
-        tmp = g_strndup(title, end_ptr - title);
-        gupnp_didl_lite_object_set_title(item, tmp);
-        g_free(tmp);
-    } else {
-        gupnp_didl_lite_object_set_title(item, title);
+        g_utf8_validate(title.constData(), 256, &end_ptr);
+        title.truncate(end_ptr - title.constData());
     }
+    gupnp_didl_lite_object_set_title(object, title.constData());
+
+    gupnp_didl_lite_object_set_upnp_class(object, item.upnpClass.toUtf8().constData());
+    gupnp_didl_lite_object_set_parent_id(object, item.parentId.toUtf8().constData());
+    gupnp_didl_lite_object_set_id(object, item.id.toUtf8().constData());
+    gupnp_didl_lite_object_set_restricted(object, item.restricted);
+    Q_FOREACH(const BrowseResource &res, item.resources) {
+        auto info = wrap(gupnp_protocol_info_new_from_string(res.protocolInfo.toUtf8().constData(), 0));
+        if (info.isEmpty()) {
+            continue;
+        }
 
-    gupnp_didl_lite_object_set_upnp_class(item, gupnp_didl_lite_object_get_upnp_class(object));
-    gupnp_didl_lite_object_set_parent_id(item, gupnp_didl_lite_object_get_parent_id(object));
-    gupnp_didl_lite_object_set_id(item, gupnp_didl_lite_object_get_id(object));
-    gupnp_didl_lite_object_set_restricted(item, gupnp_didl_lite_object_get_restricted(object));
-    it = resources = gupnp_didl_lite_object_get_resources(object);
-    while (it != 0) {
-        GUPnPDIDLLiteResource *orig_resource = GUPNP_DIDL_LITE_RESOURCE(it->data);
-        GUPnPDIDLLiteResource *resource = gupnp_didl_lite_object_add_resource(item);
-        gupnp_didl_lite_resource_set_uri(resource,
-                                         gupnp_didl_lite_resource_get_uri (orig_resource));
-        gupnp_didl_lite_resource_set_protocol_info(resource,
-                                                   gupnp_didl_lite_resource_get_protocol_info(orig_resource));
-
-        it = it->next;
+        auto resource = wrap(gupnp_didl_lite_object_add_resource(object));
+        gupnp_didl_lite_resource_set_uri(resource, res.uri.toUtf8().constData());
+        gupnp_didl_lite_resource_set_protocol_info(resource, info);
     }
-    g_list_free_full(resources, (GDestroyNotify)g_object_unref);
 
     return QString::fromUtf8(gupnp_didl_lite_writer_get_string(writer));
 }
 
+/*!
+ * \brief Find a resource of an item a renderer can play.
+ *
+ * Same choice as the BrowseRoleURI role, for items that are not in a model.
+ *
+ * \return the uri of the resource, an empty string if there is none.
+ */
+QString BrowseModelPrivate::compatibleUri(const ProtocolInfoMatcher &matcher, const BrowseItem &item)
+{
+    QString compatible;
+
+    Q_FOREACH(const BrowseResource &res, item.resources) {
+        if (not matcher.isCompatible(res.protocolInfo)) {
+            continue;
+        }
+
+        if (hasAddressHost(res.uri)) {
+            return res.uri;
+        }
+
+        if (compatible.isEmpty()) {
+            compatible = res.uri;
+        }
+    }
+
+    return compatible;
+}
+
+/*!
+ * \brief The DIDL-Lite of the BrowseRoleMetaData role for an item.
+ */
+QString BrowseModelPrivate::metaDataForItem(const BrowseItem &item)
+{
+    return generateMetaData(item);
+}
+
+/*!
+ * \brief Fill the roles derived from the DIDL-Lite properties of an item.
+ */
+static void finishItem(BrowseItem &item)
+{
+    item.icon = findIconForItem(item);
+    item.detail = createDetailsForItem(item);
+    item.titleKey = BrowseFilter::normalize(item.title);
+    item.detailKey = BrowseFilter::normalize(item.detail);
+}
+
+/*!
+ * \brief The Browse Filter asking for the properties a set of roles needs.
+ * \param roles role names as bound in QML, e.g. "title" or "icon"
+ */
+QString BrowseModelPrivate::filterForRoles(const QStringList &roles)
+{
+    QStringList filter = QString::fromLatin1(BASE_FILTER).split(QLatin1Char(','));
+
+    for (int i = 0; ROLE_PROPERTIES[i].name != 0; i++) {
+        if (not roles.contains(QLatin1String(ROLE_PROPERTIES[i].name))) {
+            continue;
+        }
+
+        Q_FOREACH(const QString &property, QString::fromLatin1(ROLE_PROPERTIES[i].properties).split(QLatin1Char(','))) {
+            if (not filter.contains(property)) {
+                filter << property;
+            }
+        }
+    }
+
+    return filter.join(QLatin1String(","));
+}
+
+/*!
+ * \brief The Browse Filter asking for everything Helium uses of an object.
+ *
+ * All properties of the roles, plus the track number the local sort
+ * orders by.
+ */
+QString BrowseModelPrivate::completeFilter()
+{
+    QStringList roles;
+
+    for (int i = 0; ROLE_PROPERTIES[i].name != 0; i++) {
+        roles << QLatin1String(ROLE_PROPERTIES[i].name);
+    }
+
+    return filterForRoles(roles) + QLatin1String(",upnp:originalTrackNumber");
+}
+
+/*!
+ * \brief Extract the properties Helium uses from a GUPnPDIDLLiteObject.
+ *
+ * Does not touch any member, so it is safe to call from the parser thread.
+ */
+BrowseItem BrowseModelPrivate::createItem(const DIDLLiteObject &object)
+{
+    BrowseItem item;
+
+    item.id = QString::fromUtf8(gupnp_didl_lite_object_get_id(object));
+    item.parentId = QString::fromUtf8(gupnp_didl_lite_object_get_parent_id(object));
+    item.title = QString::fromUtf8(gupnp_didl_lite_object_get_title(object));
+    item.upnpClass = QString::fromUtf8(gupnp_didl_lite_object_get_upnp_class(object));
+    item.artist = QString::fromUtf8(gupnp_didl_lite_object_get_artist(object));
+    item.album = QString::fromUtf8(gupnp_didl_lite_object_get_album(object));
+    item.albumArtUri = QString::fromUtf8(gupnp_didl_lite_object_get_album_art(object));
+    item.trackNumber = gupnp_didl_lite_object_get_track_number(object);
+    item.container = GUPNP_IS_DIDL_LITE_CONTAINER(object);
+    item.restricted = gupnp_didl_lite_object_get_restricted(object);
+
+    GList *resources = gupnp_didl_lite_object_get_resources(object);
+    for (GList *it = resources; it != 0; it = it->next) {
+        GUPnPDIDLLiteResource *res = GUPNP_DIDL_LITE_RESOURCE(it->data);
+        GUPnPProtocolInfo *info = gupnp_didl_lite_resource_get_protocol_info(res);
+        BrowseResource resource;
+
+        resource.uri = QString::fromUtf8(gupnp_didl_lite_resource_get_uri(res));
+        if (info != 0) {
+            ScopedGPointer protocolInfo(gupnp_protocol_info_to_string(info));
+            resource.protocolInfo = QString::fromUtf8(protocolInfo.data());
+        }
+        resource.size = gupnp_didl_lite_resource_get_size64(res);
+        resource.duration = gupnp_didl_lite_resource_get_duration(res);
+        resource.width = gupnp_didl_lite_resource_get_width(res);
+        resource.height = gupnp_didl_lite_resource_get_height(res);
+        item.resources << resource;
+    }
+    g_list_free_full(resources, g_object_unref);
+
+    finishItem(item);
+
+    return item;
+}
+
+/*!
+ * \brief Copy a DIDLLiteRecord out of the stream parser's arena.
+ *
+ * Does not touch any member, so it is safe to call from the parser thread.
+ */
+BrowseItem BrowseModelPrivate::createItem(const DIDLLiteRecord &record,
+                                          const QVector<DIDLLiteResourceRecord> &resources)
+{
+    BrowseItem item;
+
+    item.id = QString::fromUtf8(record.id);
+    item.parentId = QString::fromUtf8(record.parentId);
+    item.title = QString::fromUtf8(record.title);
+    item.upnpClass = QString::fromUtf8(record.upnpClass);
+    item.artist = QString::fromUtf8(record.artist);
+    item.album = QString::fromUtf8(record.album);
+    item.albumArtUri = QString::fromUtf8(record.albumArtUri);
+    item.trackNumber = record.originalTrackNumber;
+    item.container = record.container;
+    item.restricted = record.restricted;
+
+    for (int i = record.firstResource; i < record.firstResource + record.resourceCount; i++) {
+        const DIDLLiteResourceRecord &res = resources.at(i);
+        BrowseResource resource;
+
+        resource.uri = QString::fromUtf8(res.uri);
+        resource.protocolInfo = QString::fromUtf8(res.protocolInfo);
+        resource.size = res.size;
+        resource.duration = res.duration;
+        resource.width = res.width;
+        resource.height = res.height;
+        item.resources << resource;
+    }
+
+    finishItem(item);
+
+    return item;
+}
+
+/*!
+ * \brief Get the url a row's icon is shown from.
+ *
+ * Thumbnails from the server are loaded in the background; the row is
+ * announced as changed by onThumbnailReady() once there is one.
+ */
+QUrl BrowseModelPrivate::thumbnailUrl(int stored, const QUrl &icon) const
+{
+    const QUrl url = ThumbnailCache::thumbnailUrl(icon);
+
+    if (url.isEmpty() && not icon.isEmpty()) {
+        const QString key = icon.toString();
+        if (m_thumbnailRows.isEmpty()) {
+            connect(ThumbnailCache::instance(), SIGNAL(thumbnailReady(QString)),
+                    this, SLOT(onThumbnailReady(QString)), Qt::UniqueConnection);
+        }
+
+        if (not m_thumbnailRows.contains(key, stored)) {
+            m_thumbnailRows.insert(key, stored);
+        }
+    }
+
+    return url;
+}
+
+void BrowseModelPrivate::onThumbnailReady(const QString &url)
+{
+    Q_FOREACH(int stored, m_thumbnailRows.values(url)) {
+        const int row = displayRow(stored);
+        if (row < m_rowCount) {
+            queueChange(row, row);
+        }
+    }
+
+    m_thumbnailRows.remove(url);
+}
+
 QVariant BrowseModelPrivate::data(const QModelIndex &index, int role) const
 {
     if (!index.isValid()) {
         return QVariant();
     }
 
-    DIDLLiteObject object = m_data.at(index.row());
-    if (object.isEmpty()) {
-        return QVariant();
+    const int stored = storedRow(index.row());
+    const BrowsePage *p = page(stored);
+    const int row = stored % PAGE_SIZE;
+
+    // Row of an evicted or not yet fetched page
+    if (p == 0) {
+        switch (role) {
+        case BrowseRoleIcon:
+            return QUrl();
+        case BrowseRoleType:
+            return QLatin1String("placeholder");
+        default:
+            return QString();
+        }
+    }
+
+    // The Browse Filter left out properties of this role; the value is
+    // updated once the row has been fetched with BrowseMetadata
+    if (m_missingRoles.contains(role) && not p->rows.replaced(row)) {
+        requestMetaData(stored);
     }
 
     switch (role) {
     case BrowseRoleTitle:
-        return QString::fromUtf8(gupnp_didl_lite_object_get_title(object));
+        return p->rows.title(row);
     case BrowseRoleId:
-        return QString::fromUtf8(gupnp_didl_lite_object_get_id(object));
+        return p->rows.id(row);
     case BrowseRoleUPnPClass:
-        return QString::fromUtf8(gupnp_didl_lite_object_get_upnp_class(object));
+        return p->rows.upnpClass(row);
     case BrowseRoleIcon:
-        return findIconForObject(object);
+        return thumbnailUrl(stored, p->rows.icon(row));
     case BrowseRoleURI:
-        return getCompatibleUri(index.row(), m_protocolInfo);
+        return getCompatibleUri(stored);
     case BrowseRoleType:
-        if (GUPNP_IS_DIDL_LITE_CONTAINER(object)) {
+        if (p->rows.container(row)) {
             return QLatin1String("container");
         } else {
             return QLatin1String("object");
         }
     case BrowseRoleDetail:
-        return createDetailsForObject(object);
+        return p->rows.detail(row);
     case BrowseRoleMetaData:
-        return generateMetaData(object);
+        return generateMetaData(p->rows.item(row));
     case BrowseRoleFilter:
-        return QString::fromUtf8(gupnp_didl_lite_object_get_title(object)) + createDetailsForObject(object);
+        return p->rows.title(row) + p->rows.detail(row);
     default:
         return QVariant();
     }
@@ -388,79 +754,1399 @@ void BrowseModelPrivate::onCallReady()
         return;
     }
 
+    if (call == m_call) {
+        m_callRunning = false;
+    }
+
     call->finalize(QStringList() << QLatin1String("Result")
                                  << QLatin1String("NumberReturned")
-                                 << QLatin1String("TotalMatches"));
-    setBusy(false);
+                                 << QLatin1String("TotalMatches")
+                                 << QLatin1String("UpdateID"));
+    if (call != m_call) {
+        m_sliceCalls.removeOne(call);
+        call->deleteLater();
+    }
 
     if (call->hasError()) {
+        setBusy(false);
+        cancelSlices();
         Q_EMIT error(call->errorCode(), call->errorMessage());
 
         return;
     }
 
+    guint offset = call->arg(QLatin1String("StartingIndex")).toUInt();
+    guint requested = call->arg(QLatin1String("RequestedCount")).toUInt();
     unsigned int numberReturned = call->get(QLatin1String("NumberReturned")).toUInt();
+    unsigned int totalMatches = call->get(QLatin1String("TotalMatches")).toUInt();
+
+    if (call == m_call) {
+        m_totalMatches = totalMatches;
+        m_updateId = call->get(QLatin1String("UpdateID")).toString();
+
+        // Some servers can't count the results of a Search and report 0
+        m_totalUnknown = not m_searchText.isEmpty() && totalMatches == 0 && numberReturned > 0;
+
+        // Revalidating rows from the cache and the container did not change;
+        // keep them and continue where the cache ended
+        if (m_replaceRows &&
+            not m_updateId.isEmpty() && m_updateId != QLatin1String("0") &&
+            m_updateId == m_cachedUpdateId &&
+            m_totalMatches == m_cachedTotalMatches) {
+            qDebug() << "Cached rows are still valid";
+            m_replaceRows = false;
+            m_currentOffset = m_nextOffset = m_rowCount;
+            setBusy(false);
+            boundRows();
+            fetchSlices();
+            updateDone();
+
+            return;
+        }
+    }
+
+    // Without TotalMatches, keep paging as long as the slices come back full
+    if (m_totalUnknown) {
+        if (numberReturned >= requested) {
+            m_totalMatches = qMax(m_totalMatches, offset + numberReturned + requested);
+        } else {
+            m_totalMatches = offset + numberReturned;
+            m_totalUnknown = false;
+        }
+    }
+
+    if (call == m_call && not m_totalUnknown &&
+        m_lazy && m_rowBudget > 0 && m_totalMatches > guint(m_rowBudget)) {
+        // Outdated rows from the cache; the window is filled from scratch
+        if (m_replaceRows) {
+            m_replaceRows = false;
+            beginResetModel();
+            setRows(BrowseItemList());
+            endResetModel();
+        }
+        enterWindow();
+    }
+
+    const QByteArray result = call->get(QLatin1String("Result")).toString().toUtf8();
+
+    if (m_sliceSizer != 0) {
+        m_sliceSizer->update(requested,
+                             numberReturned,
+                             offset + numberReturned >= m_totalMatches,
+                             call->elapsed(),
+                             result.size());
+    }
+
     if (numberReturned == 0) {
-        setDone(true);
+        // Nothing left from here on, no matter what TotalMatches said
+        m_totalMatches = qMin(m_totalMatches, offset);
+        setBusy(false);
+        if (m_windowed) {
+            m_fetchingPages.remove(offset / PAGE_SIZE);
+            truncateRows(m_totalMatches);
+        }
+
+        // The container was emptied since it was cached
+        if (m_replaceRows && offset == 0) {
+            m_replaceRows = false;
+            m_cacheDirty = true;
+            beginResetModel();
+            setRows(BrowseItemList());
+            endResetModel();
+        }
+    } else {
+        // Keep fetchPages() from requesting these rows again until parsed
+        if (m_windowed) {
+            for (guint row = offset; row < offset + numberReturned; row += PAGE_SIZE) {
+                m_fetchingPages.insert(row / PAGE_SIZE);
+            }
+            m_fetchingPages.insert((offset + numberReturned - 1) / PAGE_SIZE);
+        }
+
+        m_pendingParses++;
+        Q_EMIT parseRequested(m_generation,
+                              offset,
+                              numberReturned,
+                              result);
+
+        // Server returned less than asked for, fetch the rest separately.
+        // Pages are completed by fetchPages() instead.
+        if (not m_windowed &&
+            numberReturned < requested && offset + numberReturned < m_totalMatches) {
+            m_missingSlices << qMakePair(offset + numberReturned,
+                                         requested - numberReturned);
+        }
+    }
+
+    insertSlices();
+    fetchSlices();
+    updateDone();
+}
 
+/*!
+ * \brief Queue a parsed slice for insertion.
+ *
+ * Called with the result of the parser thread.
+ */
+void BrowseModelPrivate::onSliceParsed(int generation, uint offset, uint count, const BrowseItemList &items, qint64 elapsed)
+{
+    // Result of a browse before the last refresh()
+    if (generation != m_generation) {
         return;
     }
 
-    auto objects = DIDLLiteParser().parse(call->get(QLatin1String("Result")).toString());
+    m_pendingParses--;
+    m_parseTime += elapsed;
 
-    beginInsertRows(QModelIndex(),
-                    m_data.count(),
-                    m_data.count() + numberReturned - 1);
-    m_data << objects;
-    endInsertRows();
+    setBusy(false);
+    if (m_windowed) {
+        for (guint row = offset; row < offset + count; row += PAGE_SIZE) {
+            m_fetchingPages.remove(row / PAGE_SIZE);
+        }
+        m_fetchingPages.remove((offset + count - 1) / PAGE_SIZE);
+        fillRows(offset, items);
+        fetchPages();
+    } else {
+        BrowseSlice slice;
+        slice.count = count;
+        slice.items = items;
+        m_pendingSlices.insert(offset, slice);
+        insertSlices();
+    }
+    updateDone();
+}
 
-    m_currentOffset += numberReturned;
+/*!
+ * \brief Hand the rows from first on to the sorter.
+ *
+ * Rows are sorted locally only if the server cannot sort them and all of
+ * them are loaded.
+ */
+void BrowseModelPrivate::sortRows(int first)
+{
+    if (m_sortMode == BrowseModel::SortNone || m_windowed || first >= m_rowCount) {
+        return;
+    }
 
-    unsigned int totalMatches = call->get(QLatin1String("TotalMatches")).toUInt();
-    if (totalMatches > 0 && m_currentOffset < totalMatches) {
-        m_call->setArg(QLatin1String("StartingIndex"), m_currentOffset);
-        m_call->run();
+    QStringList titles, classes;
+    QVector<int> trackNumbers;
+
+    trackNumbers.reserve(m_rowCount - first);
+    for (int row = first; row < m_rowCount; row++) {
+        const BrowseRowStore &rows = page(row)->rows;
+
+        titles << rows.title(row % PAGE_SIZE);
+        classes << rows.upnpClass(row % PAGE_SIZE);
+        trackNumbers << rows.trackNumber(row % PAGE_SIZE);
+    }
+
+    m_pendingSorts++;
+    Q_EMIT sortRequested(m_sortGeneration, m_sortMode, first, titles, classes, trackNumbers);
+}
+
+/*!
+ * \brief Keep the order of the rows sorted so far.
+ *
+ * Called with the result of the sorter thread. Lazy models show it right
+ * away, others once all rows are there, so the rows of a container are
+ * only reordered once.
+ */
+void BrowseModelPrivate::onRowsSorted(int generation, const QVector<int> &order, qint64 elapsed)
+{
+    Q_UNUSED(elapsed);
+
+    // Rows from before the last refresh()
+    if (generation != m_sortGeneration) {
+        return;
+    }
+
+    // A later batch is queued already, its order includes this one
+    if (--m_pendingSorts > 0) {
+        return;
+    }
+
+    m_sortedOrder = order;
+    if (m_lazy || m_done) {
+        applyOrder();
+    }
+}
+
+/*!
+ * \brief Show the rows in the order handed back by the sorter.
+ *
+ * The order covers all rows up to the last batch sorted; rows added since
+ * stay at the end until they are sorted in as well.
+ */
+void BrowseModelPrivate::applyOrder()
+{
+    const QVector<int> order = m_sortedOrder;
+    QVector<int> position(order.count());
+
+    m_sortedOrder.clear();
+    if (order.count() > m_rowCount) {
+        return;
+    }
+
+    for (int i = 0; i < order.count(); i++) {
+        position[order.at(i)] = i;
+    }
+
+    Q_EMIT layoutAboutToBeChanged();
+
+    const QModelIndexList from = persistentIndexList();
+    QModelIndexList to;
+    Q_FOREACH(const QModelIndex &index, from) {
+        const int stored = storedRow(index.row());
+
+        to << this->index(stored < position.count() ? position.at(stored) : stored);
+    }
+    changePersistentIndexList(from, to);
+
+    int lastIndex = m_lastIndex;
+    if (lastIndex >= 0 && lastIndex < m_rowCount) {
+        lastIndex = storedRow(lastIndex);
+        lastIndex = lastIndex < position.count() ? position.at(lastIndex) : lastIndex;
+    }
+
+    m_order = order;
+    m_position = position;
+
+    Q_EMIT layoutChanged();
+    setLastIndex(lastIndex);
+}
+
+void BrowseModelPrivate::updateDone()
+{
+    const bool wasDone = m_done;
+
+    if (m_windowed) {
+        int first, last;
+        bool complete = true;
+
+        wantedPages(&first, &last);
+        for (int i = first; i <= last && complete; i++) {
+            complete = pageComplete(i);
+        }
+
+        setDone(m_sliceCalls.isEmpty() && m_pendingParses == 0 && complete);
     } else {
-        setDone(true);
+        setDone(m_sliceCalls.isEmpty() &&
+                m_pendingParses == 0 &&
+                m_queuedRows.isEmpty() &&
+                m_currentOffset >= qMin(m_totalMatches, m_fetchLimit));
+    }
+
+    if (m_done && not wasDone) {
+        qDebug() << "Spent" << m_parseTime << "ms parsing" << m_loadedRows << "objects";
+        if (m_loadedRows > 0) {
+            qDebug() << "Rows use" << memoryUsage() << "bytes,"
+                     << memoryUsage() / m_loadedRows << "per row";
+        }
+        if (m_flushes > 0) {
+            qDebug() << "Merged" << m_queuedUpdates << "updates of" << m_flushedRows
+                     << "rows into" << m_flushes << "flushes";
+        }
+    }
+
+    // All pages are back after leaving lazy mode
+    if (m_done && m_filterStale && m_loadedRows == m_rowCount) {
+        Q_Q(BrowseModel);
+
+        rebuildFilter();
+        q->invalidateFilter();
+    }
+
+    if (m_done && not m_sortedOrder.isEmpty()) {
+        applyOrder();
+    }
+
+    // A lazy model is done after every lookahead window; the container is
+    // only stored once, when all of it is there
+    if (m_done && m_cacheDirty && guint(m_loadedRows) >= m_totalMatches) {
+        storeCache();
     }
 }
 
-void BrowseModelPrivate::refresh() {
-    beginResetModel();
-    setDone(false);
-    setBusy(true);
-    m_currentOffset = 0;
-    m_data.clear();
-    qDebug () << "Starting to browse" << m_call->arg(QLatin1String("ObjectID"));
-    m_call->setArg(QLatin1String("StartingIndex"), m_currentOffset);
-    m_call->run();
-    endResetModel();
+void BrowseModelPrivate::setCache(const QString &key,
+                                  const QString &systemUpdateId,
+                                  const QString &containerUpdateId)
+{
+    m_cacheKey = key;
+    m_systemUpdateId = systemUpdateId;
+    m_containerUpdateId = containerUpdateId;
 }
 
-QString BrowseModelPrivate::formatTime(long duration)
+/*!
+ * \brief Check whether the rows still reflect the server's content.
+ *
+ * If the server does not event its update ids, there is nothing to check
+ * against and the rows are considered current.
+ */
+bool BrowseModelPrivate::isCurrent(const QString &systemUpdateId,
+                                   const QString &containerUpdateId) const
 {
-    return ::formatTime(duration);
+    if (systemUpdateId.isEmpty() && containerUpdateId.isEmpty()) {
+        return true;
+    }
+
+    return (not containerUpdateId.isEmpty() && containerUpdateId == m_updateId) ||
+           (not systemUpdateId.isEmpty() && systemUpdateId == m_systemUpdateId);
 }
 
-void BrowseModelPrivate::setProtocolInfo(const QString& protocolInfo)
+/*!
+ * \brief Memory used by the rows of the model, including the filter keys.
+ */
+qint64 BrowseModelPrivate::memoryUsage() const
 {
-    if (protocolInfo != m_protocolInfo) {
-        m_protocolInfo = protocolInfo;
-        Q_EMIT protocolInfoChanged();
-        Q_EMIT dataChanged(index(0), index(m_data.count() - 1));
+    qint64 size = m_pool.memoryUsage() +
+                  m_filter.memoryUsage() +
+                  m_pages.capacity() * sizeof(BrowsePage *);
+
+    Q_FOREACH(const BrowsePage *p, m_pages) {
+        if (p != 0) {
+            size += sizeof(BrowsePage) +
+                    p->rows.memoryUsage() +
+                    p->uris.capacity() * sizeof(quint32);
+        }
     }
+
+    return size;
 }
 
-void BrowseModelPrivate::setLastIndex(int index)
+QString BrowseModelPrivate::objectId() const
 {
-    if (index != m_lastIndex) {
-        m_lastIndex = index;
-        Q_EMIT lastIndexChanged();
+    if (m_call == 0) {
+        return QString();
     }
+
+    return m_call->arg(QLatin1String("ObjectID")).toString();
 }
 
-void BrowseModelPrivate::onFilterInDetailsChanged()
+QString BrowseModelPrivate::browseFilter() const
 {
-    Q_Q(BrowseModel);
-    q->setFilterRole(m_settings.filterInDetails() ? BrowseModelPrivate::BrowseRoleFilter : BrowseModelPrivate::BrowseRoleTitle);
+    if (m_call == 0) {
+        return QString();
+    }
+
+    return m_call->arg(QLatin1String("Filter")).toString();
+}
+
+/*!
+ * \brief Copy a row, so it can be played after the model is gone.
+ *
+ * \param row the row as shown
+ * \param item set to the row if it is loaded; only the id is set if the
+ *        Browse Filter left out properties needed to play it
+ * \param position set to the position of the row in the container, for
+ *        fetching rows that are not loaded
+ */
+BrowseModelPrivate::RowSnapshot BrowseModelPrivate::snapshotRow(int row, BrowseItem *item, int *position) const
+{
+    const int stored = storedRow(row);
+    const BrowsePage *p = page(stored);
+
+    *position = stored;
+    *item = BrowseItem();
+    if (p == 0) {
+        return RowNotLoaded;
+    }
+
+    if (p->rows.container(stored % PAGE_SIZE)) {
+        return RowContainer;
+    }
+
+    if (not p->rows.replaced(stored % PAGE_SIZE) &&
+        (m_missingRoles.contains(BrowseRoleURI) || m_missingRoles.contains(BrowseRoleMetaData))) {
+        item->id = p->rows.id(stored % PAGE_SIZE);
+
+        return RowIncomplete;
+    }
+
+    *item = p->rows.item(stored % PAGE_SIZE);
+
+    return RowComplete;
+}
+
+/*!
+ * \brief Set the call used to fetch rows the Browse Filter left properties
+ * out of.
+ *
+ * \param call BrowseMetadata call asking for all properties; ObjectID is
+ *        set per row. Takes ownership.
+ */
+void BrowseModelPrivate::setMetaDataCall(ServiceProxyCall *call)
+{
+    delete m_metaDataCall;
+    m_metaDataCall = call;
+    if (m_metaDataCall != 0) {
+        m_metaDataCall->setParent(this);
+    }
+}
+
+/*!
+ * \brief Queue a row for BrowseMetadata.
+ *
+ * The calls are started from the event loop, not from within data().
+ */
+void BrowseModelPrivate::requestMetaData(int row) const
+{
+    if (m_metaDataCall == 0 ||
+        m_metaDataQueue.contains(row) ||
+        not m_metaDataCalls.keys(row).isEmpty()) {
+        return;
+    }
+
+    // The rows asked for last are the ones on screen
+    m_metaDataQueue.prepend(row);
+    if (m_metaDataQueue.count() > MAX_METADATA_QUEUE) {
+        m_metaDataQueue.removeLast();
+    }
+
+    if (not m_metaDataTimer.isActive()) {
+        m_metaDataTimer.start();
+    }
+}
+
+void BrowseModelPrivate::startMetaDataCalls()
+{
+    if (m_suspended) {
+        return;
+    }
+
+    while (m_metaDataCalls.count() < MAX_METADATA_CALLS && not m_metaDataQueue.isEmpty()) {
+        const int row = m_metaDataQueue.takeFirst();
+        const BrowsePage *p = page(row);
+
+        // Evicted or already fetched
+        if (p == 0 || p->rows.replaced(row % PAGE_SIZE)) {
+            continue;
+        }
+
+        auto call = m_metaDataCall->clone(this);
+        call->setArg(QLatin1String("ObjectID"), p->rows.id(row % PAGE_SIZE));
+        connect(call, SIGNAL(ready()), SLOT(onMetaDataReady()));
+        m_metaDataCalls.insert(call, row);
+        runCall(call, m_foreground ? BrowseScheduler::PriorityVisible
+                                   : BrowseScheduler::PriorityPrefetch);
+    }
+}
+
+void BrowseModelPrivate::cancelMetaDataCalls()
+{
+    QList<ServiceProxyCall *> calls = m_metaDataCalls.keys();
+
+    m_metaDataCalls.clear();
+    m_metaDataQueue.clear();
+    Q_FOREACH(ServiceProxyCall *call, calls) {
+        call->disconnect(this);
+        cancelCall(call);
+        call->deleteLater();
+    }
+}
+
+/*!
+ * \brief Replace a row by its BrowseMetadata result.
+ *
+ * If the call failed, the row is kept as it is and not fetched again.
+ */
+void BrowseModelPrivate::onMetaDataReady()
+{
+    auto call = qobject_cast<ServiceProxyCall *>(sender());
+    if (call == 0 || call->cancelled()) {
+        return;
+    }
+
+    call->finalize(QStringList() << QLatin1String("Result"));
+    call->deleteLater();
+
+    const int row = m_metaDataCalls.take(call);
+    const QString id = call->arg(QLatin1String("ObjectID")).toString();
+    BrowsePage *p = m_pages.value(row / PAGE_SIZE);
+
+    // The row was evicted or the model refreshed meanwhile
+    if (p == 0 || row % PAGE_SIZE >= p->rows.count() || p->rows.id(row % PAGE_SIZE) != id) {
+        startMetaDataCalls();
+
+        return;
+    }
+
+    BrowseItem item = p->rows.item(row % PAGE_SIZE);
+    if (call->hasError()) {
+        qDebug() << "Failed to fetch metadata of" << id << call->errorMessage();
+    } else {
+        const QByteArray result = call->get(QLatin1String("Result")).toString().toUtf8();
+        DIDLLiteStreamParser parser;
+
+        if (parser.parse(result.constData(), result.size())) {
+            Q_FOREACH(const DIDLLiteRecord &record, parser.records()) {
+                if (QString::fromUtf8(record.id) == id) {
+                    item = createItem(record, parser.resources());
+                    break;
+                }
+            }
+        }
+    }
+
+    p->rows.replace(row % PAGE_SIZE, item);
+    if (row % PAGE_SIZE < p->uris.count()) {
+        p->uris[row % PAGE_SIZE] = 0;
+    }
+    Q_EMIT dataChanged(index(displayRow(row)), index(displayRow(row)));
+
+    startMetaDataCalls();
+}
+
+void BrowseModelPrivate::storeCache()
+{
+    // Evicted rows can not be stored
+    if (m_cacheKey.isEmpty() || m_loadedRows < m_rowCount || m_filterStale) {
+        return;
+    }
+
+    BrowseCache::Entry entry;
+    entry.systemUpdateId = m_systemUpdateId;
+    entry.containerUpdateId = m_updateId;
+    entry.totalMatches = m_totalMatches;
+    for (int row = 0; row < m_rowCount; row++) {
+        BrowseItem item = page(row)->rows.item(row % PAGE_SIZE);
+
+        item.titleKey = m_filter.titleKey(row);
+        item.detailKey = m_filter.detailKey(row);
+        entry.items << item;
+    }
+
+    BrowseCache::storeLater(m_cacheKey, entry);
+    m_cacheDirty = false;
+}
+
+/*!
+ * \brief Start Browse calls for the remaining slices of the container.
+ *
+ * Once the size of the container is known, up to m_maxSliceCalls slices are
+ * requested concurrently. Gaps left by servers returning less than requested
+ * are fetched first. In lazy mode, only slices up to m_fetchLimit are
+ * requested.
+ */
+void BrowseModelPrivate::fetchSlices()
+{
+    if (m_suspended) {
+        return;
+    }
+
+    if (m_windowed) {
+        fetchPages();
+
+        return;
+    }
+
+    const guint sliceSize = m_sliceSizer != 0 ? m_sliceSizer->sliceSize()
+                                              : m_call->arg(QLatin1String("RequestedCount")).toUInt();
+
+    while (m_sliceCalls.count() < m_maxSliceCalls) {
+        guint offset, count;
+
+        if (not m_missingSlices.isEmpty()) {
+            auto missing = m_missingSlices.takeFirst();
+            offset = missing.first;
+            count = missing.second;
+        } else if (m_nextOffset < qMin(m_totalMatches, m_fetchLimit)) {
+            offset = m_nextOffset;
+            count = qMin(sliceSize, m_totalMatches - m_nextOffset);
+            m_nextOffset += count;
+        } else {
+            break;
+        }
+
+        auto call = m_call->clone(this);
+        call->setArg(QLatin1String("StartingIndex"), offset);
+        call->setArg(QLatin1String("RequestedCount"), count);
+        connect(call, SIGNAL(ready()), SLOT(onCallReady()));
+        m_sliceCalls << call;
+        runCall(call, slicePriority(offset, count));
+        setDone(false);
+    }
+}
+
+/*!
+ * \brief Move all slices that continue the current model into the model.
+ *
+ * Slices may finish in any order; they are only inserted once all slices
+ * before them have been inserted.
+ */
+void BrowseModelPrivate::insertSlices()
+{
+    BrowseItemList items;
+
+    while (not m_pendingSlices.isEmpty() &&
+           m_pendingSlices.begin().key() <= m_currentOffset) {
+        guint offset = m_pendingSlices.begin().key();
+        BrowseSlice slice = m_pendingSlices.take(offset);
+
+        // Overlaps what we already have; drop it
+        if (offset < m_currentOffset) {
+            continue;
+        }
+
+        items << slice.items;
+        m_currentOffset += slice.count;
+    }
+
+    if (items.isEmpty()) {
+        return;
+    }
+
+    m_cacheDirty = true;
+
+    // Replace the rows shown from the cache by the revalidated ones
+    if (m_replaceRows) {
+        m_replaceRows = false;
+        beginResetModel();
+        setRows(items);
+        endResetModel();
+
+        return;
+    }
+
+    queueRows(items);
+}
+
+void BrowseModelPrivate::cancelSlices()
+{
+    QList<ServiceProxyCall *> calls = m_sliceCalls;
+
+    m_sliceCalls.clear();
+    m_fetchingPages.clear();
+    Q_FOREACH(ServiceProxyCall *call, calls) {
+        call->disconnect(this);
+        cancelCall(call);
+        call->deleteLater();
+    }
+}
+
+/*!
+ * \brief Run a call through the scheduler of the server.
+ * \param call the call to run
+ * \param priority a BrowseScheduler::Priority
+ */
+void BrowseModelPrivate::runCall(ServiceProxyCall *call, int priority)
+{
+    if (m_scheduler == 0) {
+        call->run();
+
+        return;
+    }
+
+    m_scheduler->run(call, BrowseScheduler::Priority(priority));
+}
+
+void BrowseModelPrivate::cancelCall(ServiceProxyCall *call)
+{
+    if (m_scheduler == 0) {
+        call->cancel();
+
+        return;
+    }
+
+    m_scheduler->cancel(call);
+}
+
+/*!
+ * \brief How urgent the rows from offset on are for the user.
+ */
+int BrowseModelPrivate::slicePriority(guint offset, guint count) const
+{
+    if (not m_foreground) {
+        return BrowseScheduler::PriorityPrefetch;
+    }
+
+    if (int(offset) > m_viewRow) {
+        return BrowseScheduler::PriorityLookahead;
+    }
+
+    // Pages show up as they arrive in windowed mode, so only the ones on
+    // screen are urgent. Otherwise, all rows up to the view are.
+    if (m_windowed && int(offset + count) <= m_viewRow - PAGE_SIZE) {
+        return BrowseScheduler::PriorityLookahead;
+    }
+
+    return BrowseScheduler::PriorityVisible;
+}
+
+/*!
+ * \brief Update the priority of the waiting calls after the view moved.
+ */
+void BrowseModelPrivate::reprioritize()
+{
+    if (m_scheduler == 0) {
+        return;
+    }
+
+    Q_FOREACH(ServiceProxyCall *call, m_sliceCalls) {
+        const int priority = slicePriority(call->arg(QLatin1String("StartingIndex")).toUInt(),
+                                           call->arg(QLatin1String("RequestedCount")).toUInt());
+
+        m_scheduler->setPriority(call, BrowseScheduler::Priority(priority));
+    }
+
+    Q_FOREACH(ServiceProxyCall *call, m_metaDataCalls.keys()) {
+        m_scheduler->setPriority(call, m_foreground ? BrowseScheduler::PriorityVisible
+                                                    : BrowseScheduler::PriorityPrefetch);
+    }
+
+    if (m_callRunning) {
+        m_scheduler->setPriority(m_call, BrowseScheduler::Priority(slicePriority(0, 1)));
+    }
+}
+
+/*!
+ * \brief Tell the model whether it is the one on screen.
+ *
+ * Calls of models in the background only run while the server has nothing
+ * to do for the model on screen.
+ */
+void BrowseModelPrivate::setForeground(bool foreground)
+{
+    if (foreground != m_foreground) {
+        m_foreground = foreground;
+        reprioritize();
+    }
+}
+
+/*!
+ * \brief Cancel all calls of the model until resume() is called.
+ *
+ * Used when the model is popped from the BrowseModelStack. Slices that were
+ * being fetched are fetched again on resume().
+ */
+void BrowseModelPrivate::suspend()
+{
+    if (m_suspended) {
+        return;
+    }
+
+    m_suspended = true;
+    if (not m_windowed) {
+        QList<QPair<guint, guint> > slices;
+
+        Q_FOREACH(ServiceProxyCall *call, m_sliceCalls) {
+            slices << qMakePair(call->arg(QLatin1String("StartingIndex")).toUInt(),
+                                call->arg(QLatin1String("RequestedCount")).toUInt());
+        }
+        m_missingSlices = slices + m_missingSlices;
+    }
+
+    cancelSlices();
+    cancelMetaDataCalls();
+    if (m_callRunning) {
+        cancelCall(m_call);
+    }
+    setBusy(false);
+}
+
+void BrowseModelPrivate::resume()
+{
+    if (not m_suspended) {
+        return;
+    }
+
+    m_suspended = false;
+    if (m_callRunning) {
+        setBusy(m_rowCount == 0);
+        runCall(m_call, slicePriority(0, 1));
+
+        return;
+    }
+
+    fetchSlices();
+    updateDone();
+}
+
+/*!
+ * \brief Browse the container from the start.
+ *
+ * On the first refresh of a model with a cache key, the rows are taken from
+ * the cache. If the update ids the cache was stored with are still current,
+ * browsing continues after the cached rows; otherwise the cached rows are
+ * shown until the container has been browsed again.
+ */
+void BrowseModelPrivate::refresh() {
+    BrowseCache::Entry entry;
+    bool cached = not m_cacheKey.isEmpty() &&
+                  m_rowCount == 0 &&
+                  BrowseCache::load(m_cacheKey, &entry);
+
+    beginResetModel();
+    cancelSlices();
+    m_generation++;
+    m_pendingParses = 0;
+    m_parseTime = 0;
+    m_queuedUpdates = m_flushedRows = m_flushes = 0;
+    m_flushTimer.setInterval(qMax(0, m_settings.browseInsertInterval()));
+    setDone(false);
+    m_fetchLimit = m_lazy ? LAZY_LOOKAHEAD : G_MAXUINT;
+    if (m_sliceSizer != 0) {
+        m_call->setArg(QLatin1String("RequestedCount"), m_sliceSizer->sliceSize());
+    }
+    m_maxSliceCalls = qMax(1, m_settings.browseRequests());
+    if (m_scheduler != 0) {
+        m_scheduler->setMaxRunning(qMax(m_scheduler->maxRunning(), m_maxSliceCalls + 1));
+    }
+    m_rowBudget = m_settings.browseRowBudget();
+    setRows(entry.items);
+    m_pendingSlices.clear();
+    m_missingSlices.clear();
+    m_cacheDirty = false;
+    endResetModel();
+
+    if (cached &&
+        ((not m_containerUpdateId.isEmpty() && entry.containerUpdateId == m_containerUpdateId) ||
+         (not m_systemUpdateId.isEmpty() && entry.systemUpdateId == m_systemUpdateId))) {
+        qDebug() << "Using" << m_rowCount << "cached rows for" << m_call->arg(QLatin1String("ObjectID"));
+        m_updateId = entry.containerUpdateId;
+        m_totalMatches = entry.totalMatches;
+        m_currentOffset = m_nextOffset = m_rowCount;
+        setBusy(false);
+        boundRows();
+        fetchSlices();
+        updateDone();
+
+        return;
+    }
+
+    m_replaceRows = cached;
+    m_cachedUpdateId = entry.containerUpdateId;
+    m_cachedTotalMatches = entry.totalMatches;
+    setBusy(not cached);
+    m_currentOffset = 0;
+    m_totalMatches = 0;
+    m_totalUnknown = false;
+    m_nextOffset = m_call->arg(QLatin1String("RequestedCount")).toUInt();
+    qDebug () << "Starting to browse" << m_call->arg(QLatin1String("ObjectID"));
+    m_call->setArg(QLatin1String("StartingIndex"), m_currentOffset);
+    m_callRunning = true;
+    runCall(m_call, slicePriority(0, 1));
+}
+
+QString BrowseModelPrivate::formatTime(long duration)
+{
+    return ::formatTime(duration);
+}
+
+void BrowseModelPrivate::setProtocolInfo(const QString& protocolInfo)
+{
+    if (protocolInfo != m_protocolInfo) {
+        m_protocolInfo = protocolInfo;
+        m_matcher = ProtocolInfoMatcher(m_protocolInfo);
+        // 0 is the generation of rows that were never resolved
+        if (++m_uriGeneration == 0) {
+            m_uriGeneration++;
+            Q_FOREACH(BrowsePage *p, m_pages) {
+                if (p != 0) {
+                    p->uris.fill(0);
+                }
+            }
+        }
+        Q_EMIT protocolInfoChanged();
+
+        // Only rows whose uri was asked for can have changed; the range
+        // is one of stored rows, which sorted rows are scattered across
+        if (m_resolvedFirst >= 0) {
+            int first = m_order.isEmpty() ? m_resolvedFirst : 0;
+            int last = m_order.isEmpty() ? qMin(m_resolvedLast, m_rowCount - 1) : m_rowCount - 1;
+
+            m_resolvedFirst = m_resolvedLast = -1;
+            if (first <= last) {
+                queueChange(first, last);
+            }
+        }
+    }
+}
+
+void BrowseModelPrivate::setLastIndex(int index)
+{
+    if (index != m_lastIndex) {
+        m_lastIndex = index;
+        Q_EMIT lastIndexChanged();
+    }
+}
+
+void BrowseModelPrivate::onFilterInDetailsChanged()
+{
+    Q_Q(BrowseModel);
+
+    m_filter.setIncludeDetails(m_settings.filterInDetails());
+    q->invalidateFilter();
+}
+
+/*!
+ * \brief The page holding row, if the row is loaded.
+ */
+const BrowsePage *BrowseModelPrivate::page(int row) const
+{
+    const BrowsePage *p = m_pages.value(row / PAGE_SIZE);
+
+    if (p == 0 || p->rows.count() <= row % PAGE_SIZE) {
+        return 0;
+    }
+
+    return p;
+}
+
+/*!
+ * \brief Store item as row.
+ *
+ * Rows of a page can only be stored in order; returns false for rows that
+ * do not directly follow the loaded rows of their page.
+ */
+bool BrowseModelPrivate::storeRow(int row, const BrowseItem &item)
+{
+    const int index = row / PAGE_SIZE;
+
+    if (index >= m_pages.count()) {
+        m_pages.resize(index + 1);
+    }
+
+    if (m_pages.at(index) == 0) {
+        m_pages[index] = new BrowsePage(&m_pool);
+    }
+
+    BrowsePage *p = m_pages.at(index);
+    if (p->rows.count() != row % PAGE_SIZE) {
+        return false;
+    }
+
+    p->rows.append(item);
+    m_loadedRows++;
+
+    return true;
+}
+
+/*!
+ * \brief Remove all rows. Must be called between a model reset.
+ */
+void BrowseModelPrivate::clearRows()
+{
+    cancelMetaDataCalls();
+    qDeleteAll(m_pages);
+    m_pages.clear();
+    m_pool = BrowseStringPool();
+    m_rowCount = 0;
+    m_loadedRows = 0;
+    m_windowed = false;
+    m_fetchingPages.clear();
+    m_filter.clear();
+    m_filterStale = false;
+    m_resolvedFirst = m_resolvedLast = -1;
+    m_queuedRows.clear();
+    m_changedFirst = m_changedLast = -1;
+    m_flushTimer.stop();
+    m_sortGeneration++;
+    m_pendingSorts = 0;
+    m_order.clear();
+    m_position.clear();
+    m_sortedOrder.clear();
+    m_thumbnailRows.clear();
+}
+
+/*!
+ * \brief Replace all rows. Must be called between a model reset.
+ */
+void BrowseModelPrivate::setRows(const BrowseItemList &items)
+{
+    clearRows();
+    Q_FOREACH(const BrowseItem &item, items) {
+        storeRow(m_rowCount++, item);
+        m_filter.append(item.titleKey, item.detailKey);
+    }
+    sortRows(0);
+}
+
+/*!
+ * \brief Add rows at the end of the model.
+ */
+void BrowseModelPrivate::appendRows(const BrowseItemList &items)
+{
+    const int first = m_rowCount;
+
+    beginInsertRows(QModelIndex(),
+                    m_rowCount,
+                    m_rowCount + items.count() - 1);
+    Q_FOREACH(const BrowseItem &item, items) {
+        storeRow(m_rowCount++, item);
+        m_filter.append(item.titleKey, item.detailKey);
+    }
+    endInsertRows();
+
+    sortRows(first);
+}
+
+/*!
+ * \brief Add rows at the end of the model with the next flushRows().
+ *
+ * Slices arriving from several calls within one flush interval reach the
+ * view as a single insertion.
+ */
+void BrowseModelPrivate::queueRows(const BrowseItemList &items)
+{
+    m_queuedRows << items;
+    m_queuedUpdates++;
+    if (not m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+}
+
+/*!
+ * \brief Announce changed rows with the next flushRows().
+ *
+ * Ranges queued within one flush interval are announced as the range
+ * covering all of them.
+ */
+void BrowseModelPrivate::queueChange(int first, int last)
+{
+    if (m_changedFirst < 0) {
+        m_changedFirst = first;
+        m_changedLast = last;
+    } else {
+        m_changedFirst = qMin(m_changedFirst, first);
+        m_changedLast = qMax(m_changedLast, last);
+    }
+    m_queuedUpdates++;
+    if (not m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+}
+
+/*!
+ * \brief Hand queued rows and changes to the view.
+ *
+ * Runs at most once per browseInsertInterval milliseconds, so that the
+ * view lays out its delegates once per frame instead of once per slice.
+ * An interval of 0 still merges everything queued in one pass of the event
+ * loop.
+ */
+void BrowseModelPrivate::flushRows()
+{
+    if (m_queuedRows.isEmpty() && m_changedFirst < 0) {
+        return;
+    }
+
+    m_flushes++;
+    if (not m_queuedRows.isEmpty()) {
+        BrowseItemList items = m_queuedRows;
+
+        m_queuedRows.clear();
+        m_flushedRows += items.count();
+        appendRows(items);
+    }
+
+    // Rows may have been dropped since the change was queued
+    const int last = qMin(m_changedLast, m_rowCount - 1);
+    if (m_changedFirst >= 0 && m_changedFirst <= last) {
+        Q_EMIT dataChanged(index(m_changedFirst), index(last));
+    }
+    m_changedFirst = m_changedLast = -1;
+
+    updateDone();
+}
+
+/*!
+ * \brief Turn placeholder rows starting at offset into items.
+ *
+ * Only used in windowed mode, where all TotalMatches rows already exist.
+ */
+void BrowseModelPrivate::fillRows(guint offset, const BrowseItemList &items)
+{
+    int first = -1, last = -1;
+
+    for (int i = 0; i < items.count() && int(offset) + i < m_rowCount; i++) {
+        if (storeRow(offset + i, items.at(i))) {
+            if (first < 0) {
+                first = offset + i;
+            }
+            last = offset + i;
+        }
+    }
+
+    if (first >= 0) {
+        m_cacheDirty = true;
+        queueChange(first, last);
+    }
+
+    evictPages();
+}
+
+/*!
+ * \brief Drop the rows from count on, after the container shrunk.
+ */
+void BrowseModelPrivate::truncateRows(int count)
+{
+    if (count >= m_rowCount) {
+        return;
+    }
+
+    beginRemoveRows(QModelIndex(), count, m_rowCount - 1);
+    for (int i = (count + PAGE_SIZE - 1) / PAGE_SIZE; i < m_pages.count(); i++) {
+        if (m_pages.at(i) != 0) {
+            m_loadedRows -= m_pages.at(i)->rows.count();
+            delete m_pages.at(i);
+        }
+    }
+    m_pages.resize((count + PAGE_SIZE - 1) / PAGE_SIZE);
+    m_rowCount = count;
+    endRemoveRows();
+}
+
+/*!
+ * \brief Switch to windowed mode for a container larger than the budget.
+ *
+ * All TotalMatches rows are added at once as placeholders. From then on,
+ * rows are fetched page by page around the view and pages far from it are
+ * evicted once more than m_rowBudget rows are loaded. The filter is not
+ * maintained until all rows are loaded again.
+ */
+void BrowseModelPrivate::enterWindow()
+{
+    qDebug() << "Browsing" << m_totalMatches << "rows in a window of"
+             << m_rowBudget << "rows";
+
+    m_windowed = true;
+    m_filterStale = true;
+    m_filter.clear();
+
+    // Evicted rows can not be sorted
+    m_sortGeneration++;
+    m_pendingSorts = 0;
+
+    if (m_totalMatches > guint(m_rowCount)) {
+        beginInsertRows(QModelIndex(), m_rowCount, m_totalMatches - 1);
+        m_rowCount = m_totalMatches;
+        endInsertRows();
+    }
+}
+
+/*!
+ * \brief Switch to windowed mode if the rows loaded so far exceed the budget.
+ *
+ * For rows which were loaded without a window, like the ones from the cache
+ * or the ones loaded while lazy mode was off. Pages far from the view are
+ * evicted right away.
+ */
+void BrowseModelPrivate::boundRows()
+{
+    if (not m_lazy || m_rowBudget <= 0 || m_totalMatches <= guint(m_rowBudget)) {
+        return;
+    }
+
+    if (not m_windowed) {
+        enterWindow();
+    }
+    evictPages();
+}
+
+/*!
+ * \brief Pages that should be loaded in windowed mode.
+ *
+ * In lazy mode, the pages around the last row the view reported; all pages
+ * otherwise.
+ */
+void BrowseModelPrivate::wantedPages(int *first, int *last) const
+{
+    const int lastPage = (m_rowCount - 1) / PAGE_SIZE;
+
+    if (not m_lazy) {
+        *first = 0;
+        *last = lastPage;
+
+        return;
+    }
+
+    *first = qMax(0, (m_viewRow - int(LAZY_LOOKAHEAD)) / PAGE_SIZE);
+    *last = qMin(lastPage, (m_viewRow + int(LAZY_LOOKAHEAD)) / PAGE_SIZE);
+}
+
+bool BrowseModelPrivate::pageComplete(int page) const
+{
+    const BrowsePage *p = m_pages.value(page);
+
+    return p != 0 && p->rows.count() >= qMin(PAGE_SIZE, m_rowCount - page * PAGE_SIZE);
+}
+
+/*!
+ * \brief Fetch the missing rows of the wanted pages, nearest to the view
+ * first.
+ */
+void BrowseModelPrivate::fetchPages()
+{
+    int first, last;
+
+    if (m_suspended) {
+        return;
+    }
+
+    wantedPages(&first, &last);
+    const int viewPage = qBound(first, m_viewRow / PAGE_SIZE, last);
+
+    for (int distance = 0;
+         m_sliceCalls.count() < m_maxSliceCalls &&
+         (viewPage - distance >= first || viewPage + distance <= last);
+         distance++) {
+        const int candidates[] = { viewPage + distance, viewPage - distance };
+
+        for (int i = 0; i < (distance == 0 ? 1 : 2) && m_sliceCalls.count() < m_maxSliceCalls; i++) {
+            const int index = candidates[i];
+
+            if (index < first || index > last ||
+                pageComplete(index) || m_fetchingPages.contains(index)) {
+                continue;
+            }
+
+            const int loaded = m_pages.value(index) != 0 ? m_pages.at(index)->rows.count() : 0;
+            const int offset = index * PAGE_SIZE + loaded;
+            const int count = qMin(PAGE_SIZE, m_rowCount - index * PAGE_SIZE) - loaded;
+
+            auto call = m_call->clone(this);
+            call->setArg(QLatin1String("StartingIndex"), offset);
+            call->setArg(QLatin1String("RequestedCount"), count);
+            connect(call, SIGNAL(ready()), SLOT(onCallReady()));
+            m_sliceCalls << call;
+            m_fetchingPages.insert(index);
+            runCall(call, slicePriority(offset, count));
+            setDone(false);
+        }
+    }
+}
+
+/*!
+ * \brief Drop the pages farthest from the view while over the row budget.
+ *
+ * Wanted pages are never evicted, so the budget may be exceeded if it is
+ * smaller than the window around the view.
+ */
+void BrowseModelPrivate::evictPages()
+{
+    if (not m_lazy || m_rowBudget <= 0 || m_loadedRows <= m_rowBudget) {
+        return;
+    }
+
+    int first, last, evicted = 0;
+
+    wantedPages(&first, &last);
+    for (int distance = m_pages.count(); distance > 0 && m_loadedRows > m_rowBudget; distance--) {
+        const int candidates[] = { first - distance, last + distance };
+
+        for (int i = 0; i < 2 && m_loadedRows > m_rowBudget; i++) {
+            const int index = candidates[i];
+            BrowsePage *p = m_pages.value(index);
+
+            if (p == 0 || m_fetchingPages.contains(index)) {
+                continue;
+            }
+
+            const int count = p->rows.count();
+            m_loadedRows -= count;
+            evicted += count;
+            delete p;
+            m_pages[index] = 0;
+            queueChange(index * PAGE_SIZE, index * PAGE_SIZE + count - 1);
+        }
+    }
+
+    if (evicted > 0) {
+        qDebug() << "Evicted" << evicted << "rows," << m_loadedRows << "rows left";
+    }
+}
+
+/*!
+ * \brief Recreate the filter keys of all rows. All pages have to be loaded.
+ */
+void BrowseModelPrivate::rebuildFilter()
+{
+    m_filter.clear();
+    for (int row = 0; row < m_rowCount; row++) {
+        const BrowsePage *p = page(row);
+
+        m_filter.append(BrowseFilter::normalize(p->rows.title(row % PAGE_SIZE)),
+                        BrowseFilter::normalize(p->rows.detail(row % PAGE_SIZE)));
+    }
+    m_filterStale = false;
+}
+
+/*!
+ * \brief Filter the rows for text.
+ *
+ * The caller has to invalidate the filter of the proxy model.
+ */
+void BrowseModelPrivate::setFilterText(const QString &text)
+{
+    m_filter.setQuery(text);
+}
+
+bool BrowseModelPrivate::canFetchMore(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return false;
+    }
+
+    // All rows of a windowed model exist from the start
+    return m_lazy && not m_windowed && m_nextOffset < m_totalMatches;
+}
+
+void BrowseModelPrivate::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid()) {
+        return;
+    }
+
+    fetchUpTo(m_rowCount);
+}
+
+/*!
+ * \brief Make sure rows up to row plus the lookahead are being fetched.
+ * \param row last row the view is showing
+ */
+void BrowseModelPrivate::fetchUpTo(int row)
+{
+    m_viewRow = row;
+    reprioritize();
+    if (m_windowed) {
+        fetchPages();
+        updateDone();
+
+        return;
+    }
+
+    guint limit = row + LAZY_LOOKAHEAD;
+
+    if (limit <= m_fetchLimit) {
+        return;
+    }
+
+    m_fetchLimit = limit;
+    if (m_totalMatches > 0) {
+        fetchSlices();
+    }
+}
+
+void BrowseModelPrivate::setLazy(bool lazy)
+{
+    if (lazy == m_lazy) {
+        return;
+    }
+
+    m_lazy = lazy;
+    Q_EMIT lazyChanged();
+
+    if (not m_lazy) {
+        m_fetchLimit = G_MAXUINT;
+        if (m_totalMatches > 0) {
+            fetchSlices();
+        }
+        if (m_windowed) {
+            updateDone();
+        }
+    } else {
+        // Don't keep the rows loaded for filtering
+        m_fetchLimit = m_viewRow + LAZY_LOOKAHEAD;
+        boundRows();
+    }
 }
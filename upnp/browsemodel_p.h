@@ -19,14 +19,100 @@ along with Helium.  If not, see <http://www.gnu.org/licenses/>.
 #define BROWSEMODELPRIVATE_H
 
 #include <QAbstractListModel>
+#include <QMap>
+#include <QMetaType>
+#include <QSet>
+#include <QTimer>
+#include <QUrl>
 
 #include <libgupnp-av/gupnp-av.h>
 
+#include "browsefilter.h"
+#include "browserowstore.h"
+#include "didllitestreamparser.h"
+#include "protocolinfomatcher.h"
 #include "refptrg.h"
 
 #include "settings.h"
 typedef RefPtrG<GUPnPDIDLLiteObject> DIDLLiteObject;
 
+/*!
+ * \brief A res element of a BrowseItem.
+ */
+struct BrowseResource {
+    QString uri;
+    QString protocolInfo;
+    qint64  size;
+    long    duration;
+    int     width;
+    int     height;
+};
+
+/*!
+ * \brief Per-row record of a BrowseModelPrivate.
+ *
+ * Holds a copy of the DIDL-Lite properties Helium uses, so rows do not keep
+ * a GObject tree alive. All roles that do not depend on the renderer are
+ * extracted once when the row is created. Inserted rows are kept in a
+ * BrowseRowStore.
+ */
+struct BrowseItem {
+    QString               id;
+    QString               parentId;
+    QString               title;
+    QString               upnpClass;
+    QString               artist;
+    QString               album;
+    QString               albumArtUri;
+    int                   trackNumber;
+    bool                  container;
+    bool                  restricted;
+    QList<BrowseResource> resources;
+
+    QUrl                  icon;
+    QString               detail;
+    QString               titleKey;
+    QString               detailKey;
+
+    BrowseItem()
+        : trackNumber(-1)
+        , container(false)
+        , restricted(false)
+    {
+    }
+};
+typedef QList<BrowseItem> BrowseItemList;
+Q_DECLARE_METATYPE(BrowseItemList)
+
+/*!
+ * \brief A parsed Browse result waiting to be inserted in index order.
+ */
+struct BrowseSlice {
+    guint          count;
+    BrowseItemList items;
+};
+
+/*!
+ * \brief PAGE_SIZE consecutive rows of a BrowseModelPrivate.
+ *
+ * Rows are always appended starting at the first row of the page.
+ */
+struct BrowsePage {
+    BrowseRowStore   rows;
+    // per row: generation << 16 | index of the compatible resource
+    mutable QVector<quint32> uris;
+
+    explicit BrowsePage(BrowseStringPool *pool)
+        : rows(pool)
+        , uris()
+    {
+    }
+};
+
+class BrowseResultParser;
+class BrowseScheduler;
+class BrowseSliceSizer;
+class BrowseSorter;
 class ServiceProxyCall;
 class BrowseModel;
 class BrowseModelPrivate : public QAbstractListModel
@@ -36,6 +122,7 @@ class BrowseModelPrivate : public QAbstractListModel
     Q_PROPERTY(bool done READ done NOTIFY doneChanged)
     Q_PROPERTY(QString protocolInfo READ protocolInfo WRITE setProtocolInfo NOTIFY protocolInfoChanged)
     Q_PROPERTY(int lastIndex READ lastIndex WRITE setLastIndex NOTIFY lastIndexChanged)
+    Q_PROPERTY(bool lazy READ lazy WRITE setLazy NOTIFY lazyChanged)
 public:
     enum BrowseRoles {
         BrowseRoleTitle = Qt::DisplayRole,
@@ -49,31 +136,87 @@ public:
         BrowseRoleFilter
     };
 
+    // What snapshotRow() could copy of a row
+    enum RowSnapshot {
+        RowContainer,
+        RowNotLoaded,
+        RowIncomplete,
+        RowComplete
+    };
+
+    static const int PAGE_SIZE;
+    static const int MAX_METADATA_CALLS;
+
     explicit BrowseModelPrivate(ServiceProxyCall *call = 0,
                                 const QString &protocolInfo = QLatin1String("*:*:*:*"),
+                                const QString &udn = QString(),
                                 BrowseModel *parent = 0);
     ~BrowseModelPrivate();
 
+    static QString filterForRoles(const QStringList &roles);
+    static QString completeFilter();
+    static BrowseItem createItem(const DIDLLiteObject &object);
+    static BrowseItem createItem(const DIDLLiteRecord &record,
+                                 const QVector<DIDLLiteResourceRecord> &resources);
+    static QString compatibleUri(const ProtocolInfoMatcher &matcher, const BrowseItem &item);
+    static QString metaDataForItem(const BrowseItem &item);
+
     // virtual functions from QAbstractListModel
     int rowCount(const QModelIndex &parent = QModelIndex()) const;
     QVariant data(const QModelIndex &index, int role) const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+
+    void fetchUpTo(int row);
+    void setFilterText(const QString &text);
+    bool filterAcceptsRow(int row) const { return m_filter.accepts(storedRow(row)); }
+    void setCache(const QString &key,
+                  const QString &systemUpdateId,
+                  const QString &containerUpdateId);
+    bool isCurrent(const QString &systemUpdateId,
+                   const QString &containerUpdateId) const;
+    qint64 memoryUsage() const;
+    void setMetaDataCall(ServiceProxyCall *call);
+    void setLocalSort(int sort) { m_sortMode = sort; }
+    void setForeground(bool foreground);
+    void suspend();
+    void resume();
+    QString udn() const { return m_udn; }
+    QString objectId() const;
+    QString browseFilter() const;
+    RowSnapshot snapshotRow(int row, BrowseItem *item, int *position) const;
+    ServiceProxyCall *call() const { return m_call; }
+    ServiceProxyCall *metaDataCall() const { return m_metaDataCall; }
 
     // property getters
     bool busy() const { return m_busy; }
     bool done() const { return m_done; }
     QString protocolInfo() const { return m_protocolInfo; }
     int lastIndex() const { return m_lastIndex; }
+    bool lazy() const { return m_lazy; }
+    QString searchText() const { return m_searchText; }
 
     // property setters
     void setProtocolInfo(const QString& protocolInfo);
     void setLastIndex(int index);
+    void setLazy(bool lazy);
+    void setSearchText(const QString &text) { m_searchText = text; }
 
 Q_SIGNALS:
+    void parseRequested(int generation, uint offset, uint count, const QByteArray &result);
+    void sortRequested(int generation,
+                       int mode,
+                       int first,
+                       const QStringList &titles,
+                       const QStringList &classes,
+                       const QVector<int> &trackNumbers);
+
     // property signals
     void busyChanged();
     void doneChanged();
     void protocolInfoChanged();
     void lastIndexChanged();
+    void lazyChanged();
 
     void error(int code, const QString& message);
 public Q_SLOTS:
@@ -85,6 +228,12 @@ public Q_SLOTS:
     QString formatTime(long duration);
 private Q_SLOTS:
     void onCallReady();
+    void onMetaDataReady();
+    void onSliceParsed(int generation, uint offset, uint count, const BrowseItemList &items, qint64 elapsed);
+    void onRowsSorted(int generation, const QVector<int> &order, qint64 elapsed);
+    void flushRows();
+    void startMetaDataCalls();
+    void onThumbnailReady(const QString &url);
     void setBusy(bool busy) {
         if (m_busy != busy) {
             m_busy = busy;
@@ -104,15 +253,113 @@ private Q_SLOTS:
 private:
     static BrowseModelPrivate m_empty;
 
-    QString getCompatibleUri(int index, const QString& protocolInfo) const;
+    QString getCompatibleUri(int index) const;
+    QUrl thumbnailUrl(int stored, const QUrl &icon) const;
+    void fetchSlices();
+    void insertSlices();
+    void cancelSlices();
+    void updateDone();
+    void storeCache();
+    const BrowsePage *page(int row) const;
+    bool storeRow(int row, const BrowseItem &item);
+    void clearRows();
+    void setRows(const BrowseItemList &items);
+    void appendRows(const BrowseItemList &items);
+    void queueRows(const BrowseItemList &items);
+    void queueChange(int first, int last);
+    void fillRows(guint offset, const BrowseItemList &items);
+    void truncateRows(int count);
+    void enterWindow();
+    void boundRows();
+    void wantedPages(int *first, int *last) const;
+    bool pageComplete(int page) const;
+    void fetchPages();
+    void evictPages();
+    void rebuildFilter();
+    void requestMetaData(int row) const;
+    void cancelMetaDataCalls();
+    void runCall(ServiceProxyCall *call, int priority);
+    void cancelCall(ServiceProxyCall *call);
+    int slicePriority(guint offset, guint count) const;
+    void reprioritize();
+    void sortRows(int first);
+    void applyOrder();
+    // rows are stored in the server's order and shown in m_order
+    int storedRow(int row) const { return row < m_order.count() ? m_order.at(row) : row; }
+    int displayRow(int row) const { return row < m_position.count() ? m_position.at(row) : row; }
 
-    QList<DIDLLiteObject>    m_data;
+    BrowseStringPool         m_pool;
+    QVector<BrowsePage *>    m_pages;
+    int                      m_rowCount;
+    int                      m_loadedRows;
+    bool                     m_windowed;
+    int                      m_rowBudget;
+    int                      m_viewRow;
+    QSet<int>                m_fetchingPages;
+    BrowseFilter             m_filter;
+    bool                     m_filterStale;
+    QMap<guint, BrowseSlice> m_pendingSlices;
+    QList<QPair<guint, guint> > m_missingSlices;
+    QList<ServiceProxyCall *> m_sliceCalls;
+    // rows and changes waiting for the next flushRows()
+    BrowseItemList           m_queuedRows;
+    int                      m_changedFirst;
+    int                      m_changedLast;
+    QTimer                   m_flushTimer;
+    int                      m_queuedUpdates;
+    int                      m_flushedRows;
+    int                      m_flushes;
     guint                    m_currentOffset;
+    guint                    m_nextOffset;
+    guint                    m_totalMatches;
+    // Search reported TotalMatches 0; m_totalMatches is a guess then
+    bool                     m_totalUnknown;
+    guint                    m_fetchLimit;
+    bool                     m_lazy;
+    int                      m_maxSliceCalls;
+    BrowseResultParser      *m_parser;
+    int                      m_generation;
+    int                      m_pendingParses;
+    qint64                   m_parseTime;
     bool                     m_busy;
     bool                     m_done;
     QString                  m_protocolInfo;
+    ProtocolInfoMatcher      m_matcher;
+    quint16                  m_uriGeneration;
+    mutable int              m_resolvedFirst;
+    mutable int              m_resolvedLast;
     int                      m_lastIndex;
+    QString                  m_udn;
+    QString                  m_searchText;
+    QString                  m_cacheKey;
+    QString                  m_systemUpdateId;
+    QString                  m_containerUpdateId;
+    QString                  m_updateId;
+    QString                  m_cachedUpdateId;
+    guint                    m_cachedTotalMatches;
+    bool                     m_replaceRows;
+    bool                     m_cacheDirty;
     ServiceProxyCall * m_call;
+    bool                     m_callRunning;
+    BrowseScheduler         *m_scheduler;
+    bool                     m_foreground;
+    bool                     m_suspended;
+    QSet<int>                m_missingRoles;
+    ServiceProxyCall        *m_metaDataCall;
+    QHash<ServiceProxyCall *, int> m_metaDataCalls;
+    // filled by data(), which is const; the timer starts the calls
+    mutable QList<int>       m_metaDataQueue;
+    mutable QTimer           m_metaDataTimer;
+    // rows whose thumbnail was not ready yet when data() was asked for it
+    mutable QMultiHash<QString, int> m_thumbnailRows;
+    BrowseSorter            *m_sorter;
+    int                      m_sortMode;
+    int                      m_sortGeneration;
+    int                      m_pendingSorts;
+    QVector<int>             m_order;
+    QVector<int>             m_position;
+    QVector<int>             m_sortedOrder;
+    BrowseSliceSizer * m_sliceSizer;
     Settings m_settings;
     BrowseModel *q_ptr;
     Q_DECLARE_PUBLIC(BrowseModel)
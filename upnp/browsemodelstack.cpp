@@ -23,9 +23,14 @@ extern QDeclarativeContext *rootContext;
 
 BrowseModelStack BrowseModelStack::m_instance;
 
+// Limits for the models kept around after navigating back
+const int MODEL_CACHE_SIZE = 16;
+const qint64 MODEL_CACHE_BUDGET = 8 * 1024 * 1024;
+
 BrowseModelStack::BrowseModelStack(QObject *parent)
     : QObject(parent)
     , m_stack()
+    , m_cache()
 {
 }
 
@@ -40,9 +45,15 @@ void BrowseModelStack::push(BrowseModel *model)
 
     // clear filter when navigating away
     if (not m_stack.isEmpty()) {
-        m_stack.last()->setFilterFixedString(QString());
+        m_stack.last()->setFilterText(QString());
+        m_stack.last()->setLazy(true);
+        m_stack.last()->setForeground(false);
     }
     m_stack.append(model);
+
+    // Back from the cache
+    model->setForeground(true);
+    model->resume();
 }
 
 void BrowseModelStack::pop()
@@ -53,16 +64,73 @@ void BrowseModelStack::pop()
 
     BrowseModel *head = m_stack.takeLast();
 
+    // Nobody waits for its rows anymore; don't wait for deleteLater()
+    head->suspend();
+
     if (m_stack.count() == 0) {
         rootContext->setContextProperty(QLatin1String("browseModel"), &BrowseModel::empty());
     } else {
         rootContext->setContextProperty(QLatin1String("browseModel"), m_stack.last());
+        m_stack.last()->setForeground(true);
     }
 
     // don't delete the empty model
     if (head != &BrowseModel::empty()) {
-        head->deleteLater();
+        cache(head);
+    }
+}
+
+/*!
+ * \brief Keep a popped model for when the user navigates into it again.
+ *
+ * The least recently popped models are deleted once there are more than
+ * MODEL_CACHE_SIZE of them or they use more than MODEL_CACHE_BUDGET.
+ */
+void BrowseModelStack::cache(BrowseModel *model)
+{
+    if (model->udn().isEmpty() || model->objectId().isEmpty()) {
+        model->deleteLater();
+
+        return;
+    }
+
+    m_cache.append(model);
+
+    qint64 size = 0;
+    for (int i = m_cache.count() - 1; i >= 0; i--) {
+        size += m_cache.at(i)->memoryUsage();
+        if (size > MODEL_CACHE_BUDGET || m_cache.count() - i > MODEL_CACHE_SIZE) {
+            // Everything from here on is older; drop it
+            for (int j = 0; j <= i; j++) {
+                m_cache.at(j)->deleteLater();
+            }
+            m_cache = m_cache.mid(i + 1);
+
+            break;
+        }
+    }
+}
+
+/*!
+ * \brief Take a model for the container out of the back-navigation cache.
+ *
+ * Models browsed with another Filter don't have the same properties and
+ * are not returned.
+ * \return the model or 0 if there is none. The caller has to push() it again.
+ */
+BrowseModel *BrowseModelStack::takeCached(const QString &udn, const QString &objectId, const QString &filter)
+{
+    for (int i = m_cache.count() - 1; i >= 0; i--) {
+        BrowseModel *model = m_cache.at(i);
+        if (model->udn() == udn && model->objectId() == objectId &&
+            model->browseFilter() == filter) {
+            m_cache.removeAt(i);
+
+            return model;
+        }
     }
+
+    return 0;
 }
 
 void BrowseModelStack::clear()
@@ -70,9 +138,16 @@ void BrowseModelStack::clear()
     rootContext->setContextProperty(QLatin1String("browseModel"), &BrowseModel::empty());
     Q_FOREACH(BrowseModel* model, m_stack) {
         if (model != &BrowseModel::empty()) {
+            model->suspend();
             model->deleteLater();
         }
     }
 
     m_stack.clear();
+
+    Q_FOREACH(BrowseModel* model, m_cache) {
+        model->deleteLater();
+    }
+
+    m_cache.clear();
 }
@@ -27,6 +27,8 @@ class BrowseModelStack : public QObject
 public:
     static BrowseModelStack &getDefault();
     void push(BrowseModel *model);
+    BrowseModel *takeCached(const QString &udn, const QString &objectId, const QString &filter);
+    BrowseModel *top() const { return m_stack.isEmpty() ? 0 : m_stack.last(); }
 
 Q_SIGNALS:
 
@@ -38,7 +40,12 @@ public Q_SLOTS:
 private:
     static BrowseModelStack m_instance;
     explicit BrowseModelStack(QObject *parent = 0);
+    void cache(BrowseModel *model);
+
     QList<BrowseModel*> m_stack;
+
+    // Recently popped models, least recently used first
+    QList<BrowseModel*> m_cache;
 };
 
 #endif // BROWSEMODELSTACK_H
@@ -0,0 +1,168 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <malloc.h>
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include "browseresultparser.h"
+#include "didlliteparser.h"
+#include "didllitestreamparser.h"
+
+QThread BrowseResultParser::parserThread;
+
+BrowseResultParser::BrowseResultParser()
+    : QObject(0)
+{
+    moveToThread(&BrowseResultParser::parserThread);
+    if (not BrowseResultParser::parserThread.isRunning()) {
+        qRegisterMetaType<BrowseItemList>("BrowseItemList");
+
+        // Keep the thread for the lifetime of the application; models come
+        // and go too often to start a thread for each of them.
+        qAddPostRoutine(BrowseResultParser::stopParserThread);
+        BrowseResultParser::parserThread.start();
+    }
+}
+
+/*!
+ * \brief Stop the parser thread and wait for it to finish.
+ *
+ * Runs when the application object is destroyed, so the thread is joined
+ * before the static QThread itself goes away.
+ */
+void BrowseResultParser::stopParserThread()
+{
+    BrowseResultParser::parserThread.quit();
+    BrowseResultParser::parserThread.wait();
+}
+
+static BrowseItemList parseWithStreamParser(const QByteArray &result)
+{
+    BrowseItemList items;
+    DIDLLiteStreamParser parser;
+
+    if (not parser.parse(result.constData(), result.size())) {
+        qWarning() << "Failed to parse DIDL-Lite:" << parser.errorMessage();
+    }
+
+    const QVector<DIDLLiteResourceRecord> &resources = parser.resources();
+    Q_FOREACH(const DIDLLiteRecord &record, parser.records()) {
+        items << BrowseModelPrivate::createItem(record, resources);
+    }
+
+    return items;
+}
+
+static BrowseItemList parseWithDIDLLiteParser(const QByteArray &result)
+{
+    BrowseItemList items;
+
+    auto objects = DIDLLiteParser().parse(result.constData());
+    Q_FOREACH(const DIDLLiteObject &object, objects) {
+        items << BrowseModelPrivate::createItem(object);
+    }
+
+    return items;
+}
+
+/*!
+ * \brief Bytes currently allocated on the heap.
+ *
+ * mallinfo() is deprecated and its int fields overflow past 2 GiB, so
+ * mallinfo2() is used where glibc provides it.
+ */
+static qint64 heapInUse()
+{
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+    return qint64(mallinfo2().uordblks);
+#else
+    return qint64(uint(mallinfo().uordblks));
+#endif
+}
+
+/*!
+ * \brief Run both parsers on the same result and log time and heap growth.
+ *
+ * Enabled by setting HELIUM_BENCHMARK_PARSER in the environment.
+ */
+static void benchmark(const QByteArray &result)
+{
+    QElapsedTimer timer;
+    struct {
+        const char *name;
+        BrowseItemList (*parse)(const QByteArray &);
+    } parsers[] = {
+        { "gupnp", parseWithDIDLLiteParser },
+        { "stream", parseWithStreamParser },
+        { 0, 0 }
+    };
+
+    for (int i = 0; parsers[i].name != 0; i++) {
+        qint64 heap = heapInUse();
+        timer.start();
+        BrowseItemList items = parsers[i].parse(result);
+        qint64 elapsed = timer.elapsed();
+        heap = heapInUse() - heap;
+
+        if (items.isEmpty()) {
+            continue;
+        }
+
+        qDebug() << "Benchmark:" << parsers[i].name << "parser:"
+                 << elapsed * 1000.0 / items.count() << "ms and"
+                 << heap * 1000 / items.count() << "bytes of heap per 1000 objects";
+    }
+}
+
+/*!
+ * \brief Parse a DIDL-Lite Result into BrowseItems.
+ *
+ * Emits parsed() when done. The streaming parser is used unless
+ * HELIUM_DIDL_PARSER is set to "gupnp".
+ *
+ * \param generation opaque value passed back in parsed()
+ * \param offset StartingIndex of the Browse call
+ * \param count NumberReturned of the Browse call
+ * \param result UTF-8 encoded DIDL-Lite document
+ */
+void BrowseResultParser::parse(int generation, uint offset, uint count, const QByteArray &result)
+{
+    static const bool useDIDLLiteParser = qgetenv("HELIUM_DIDL_PARSER") == "gupnp";
+    static const bool runBenchmark = not qgetenv("HELIUM_BENCHMARK_PARSER").isEmpty();
+    QElapsedTimer timer;
+    BrowseItemList items;
+
+    if (runBenchmark) {
+        benchmark(result);
+    }
+
+    timer.start();
+    if (useDIDLLiteParser) {
+        items = parseWithDIDLLiteParser(result);
+    } else {
+        items = parseWithStreamParser(result);
+    }
+
+    qint64 elapsed = timer.elapsed();
+    qDebug() << "Parsed slice at" << offset << "with" << items.count()
+             << "objects (" << result.size() << "bytes) in" << elapsed << "ms";
+
+    Q_EMIT parsed(generation, offset, count, items, elapsed);
+}
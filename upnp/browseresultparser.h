@@ -0,0 +1,49 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BROWSERESULTPARSER_H
+#define BROWSERESULTPARSER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+#include <QtCore/QThread>
+
+#include "browsemodel_p.h"
+
+/*!
+ * \brief Parses Browse results on a worker thread.
+ *
+ * Each BrowseModelPrivate owns one parser object which lives on a thread
+ * shared by all parsers. Results are passed in with parse() and handed back
+ * as BrowseItems through the parsed() signal.
+ */
+class BrowseResultParser : public QObject
+{
+    Q_OBJECT
+    static QThread parserThread;
+    static void stopParserThread();
+public:
+    explicit BrowseResultParser();
+
+public Q_SLOTS:
+    void parse(int generation, uint offset, uint count, const QByteArray &result);
+
+Q_SIGNALS:
+    void parsed(int generation, uint offset, uint count, const BrowseItemList &items, qint64 elapsed);
+};
+
+#endif // BROWSERESULTPARSER_H
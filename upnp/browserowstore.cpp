@@ -0,0 +1,266 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "browsemodel_p.h"
+#include "browserowstore.h"
+
+// Rough per-entry overhead of a QHash node and a QString header
+const qint64 POOL_ENTRY_OVERHEAD = 48;
+
+BrowseStringPool::BrowseStringPool()
+    : m_index()
+    , m_strings()
+    , m_size(0)
+{
+    // index 0 is always the empty string
+    intern(QString());
+}
+
+quint32 BrowseStringPool::intern(const QString &string)
+{
+    auto it = m_index.constFind(string);
+    if (it != m_index.constEnd()) {
+        return it.value();
+    }
+
+    quint32 index = m_strings.count();
+    m_strings << string;
+    m_index.insert(string, index);
+    m_size += POOL_ENTRY_OVERHEAD + string.size() * sizeof(QChar);
+
+    return index;
+}
+
+qint64 BrowseStringPool::memoryUsage() const
+{
+    return m_size + m_strings.capacity() * sizeof(QString);
+}
+
+BrowseRowStore::BrowseRowStore(BrowseStringPool *pool)
+    : m_pool(pool)
+    , m_strings()
+{
+    clear();
+}
+
+void BrowseRowStore::clear()
+{
+    // offset 0 is always the empty string
+    m_strings = QByteArray(1, '\0');
+
+    m_id.clear();
+    m_parentId.clear();
+    m_title.clear();
+    m_upnpClass.clear();
+    m_artist.clear();
+    m_album.clear();
+    m_albumArtPrefix.clear();
+    m_albumArtRest.clear();
+    m_icon.clear();
+    m_detail.clear();
+    m_trackNumber.clear();
+    m_flags.clear();
+    m_firstResource.clear();
+    m_resourceCount.clear();
+
+    m_resUriPrefix.clear();
+    m_resUriRest.clear();
+    m_resProtocolInfo.clear();
+    m_resSize.clear();
+    m_resDuration.clear();
+    m_resWidth.clear();
+    m_resHeight.clear();
+}
+
+void BrowseRowStore::append(const BrowseItem &item)
+{
+    m_id << addString(item.id);
+    m_parentId << addString(item.parentId);
+    m_title << addString(item.title);
+    m_upnpClass << m_pool->intern(item.upnpClass);
+    m_artist << m_pool->intern(item.artist);
+    m_album << m_pool->intern(item.album);
+    addUri(item.albumArtUri, m_albumArtPrefix, m_albumArtRest);
+    m_icon << m_pool->intern(item.icon.toString());
+    m_detail << m_pool->intern(item.detail);
+    m_trackNumber << item.trackNumber;
+    m_flags << ((item.container ? FLAG_CONTAINER : 0) |
+                (item.restricted ? FLAG_RESTRICTED : 0));
+    m_firstResource << m_resSize.count();
+    m_resourceCount << qMin(item.resources.count(), 0xffff);
+    addResources(item);
+}
+
+/*!
+ * \brief Overwrite a row with a more complete copy of it.
+ *
+ * The space used by the old strings and resources of the row is not
+ * reclaimed; this is meant for the few rows fetched again with
+ * BrowseMetadata.
+ */
+void BrowseRowStore::replace(int row, const BrowseItem &item)
+{
+    m_id[row] = addString(item.id);
+    m_parentId[row] = addString(item.parentId);
+    m_title[row] = addString(item.title);
+    m_upnpClass[row] = m_pool->intern(item.upnpClass);
+    m_artist[row] = m_pool->intern(item.artist);
+    m_album[row] = m_pool->intern(item.album);
+
+    QVector<quint32> prefix, rest;
+    addUri(item.albumArtUri, prefix, rest);
+    m_albumArtPrefix[row] = prefix.first();
+    m_albumArtRest[row] = rest.first();
+    m_icon[row] = m_pool->intern(item.icon.toString());
+    m_detail[row] = m_pool->intern(item.detail);
+    m_trackNumber[row] = item.trackNumber;
+
+    m_flags[row] = (item.container ? FLAG_CONTAINER : 0) |
+                   (item.restricted ? FLAG_RESTRICTED : 0) |
+                   FLAG_REPLACED;
+    m_firstResource[row] = m_resSize.count();
+    m_resourceCount[row] = qMin(item.resources.count(), 0xffff);
+    addResources(item);
+}
+
+void BrowseRowStore::addResources(const BrowseItem &item)
+{
+    Q_FOREACH(const BrowseResource &res, item.resources.mid(0, 0xffff)) {
+        addUri(res.uri, m_resUriPrefix, m_resUriRest);
+        m_resProtocolInfo << m_pool->intern(res.protocolInfo);
+        m_resSize << res.size;
+        m_resDuration << res.duration;
+        m_resWidth << quint16(qBound(0, res.width, 0xffff));
+        m_resHeight << quint16(qBound(0, res.height, 0xffff));
+    }
+}
+
+/*!
+ * \brief Memory used by the rows, not counting the shared string pool.
+ */
+qint64 BrowseRowStore::memoryUsage() const
+{
+    return m_strings.capacity() +
+           (m_id.capacity() + m_parentId.capacity() + m_title.capacity() +
+            m_upnpClass.capacity() + m_artist.capacity() + m_album.capacity() +
+            m_albumArtPrefix.capacity() + m_albumArtRest.capacity() +
+            m_icon.capacity() + m_detail.capacity() +
+            m_firstResource.capacity()) * sizeof(quint32) +
+           m_trackNumber.capacity() * sizeof(qint32) +
+           m_resourceCount.capacity() * sizeof(quint16) +
+           m_flags.capacity() * sizeof(quint8) +
+           (m_resUriPrefix.capacity() + m_resUriRest.capacity() +
+            m_resProtocolInfo.capacity()) * sizeof(quint32) +
+           m_resSize.capacity() * sizeof(qint64) +
+           m_resDuration.capacity() * sizeof(qint32) +
+           (m_resWidth.capacity() + m_resHeight.capacity()) * sizeof(quint16);
+}
+
+/*!
+ * \brief Copy a row back into a BrowseItem.
+ *
+ * The filter keys of the item are left empty; they are kept by the
+ * BrowseFilter.
+ */
+BrowseItem BrowseRowStore::item(int row) const
+{
+    BrowseItem item;
+
+    item.id = string(m_id.at(row));
+    item.parentId = string(m_parentId.at(row));
+    item.title = string(m_title.at(row));
+    item.upnpClass = m_pool->at(m_upnpClass.at(row));
+    item.artist = m_pool->at(m_artist.at(row));
+    item.album = m_pool->at(m_album.at(row));
+    item.albumArtUri = uri(m_albumArtPrefix.at(row), m_albumArtRest.at(row));
+    item.icon = icon(row);
+    item.detail = detail(row);
+    item.trackNumber = m_trackNumber.at(row);
+    item.container = m_flags.at(row) & FLAG_CONTAINER;
+    item.restricted = m_flags.at(row) & FLAG_RESTRICTED;
+
+    const int first = m_firstResource.at(row);
+    for (int i = first; i < first + resourceCount(row); i++) {
+        BrowseResource resource;
+
+        resource.uri = uri(m_resUriPrefix.at(i), m_resUriRest.at(i));
+        resource.protocolInfo = m_pool->at(m_resProtocolInfo.at(i));
+        resource.size = m_resSize.at(i);
+        resource.duration = m_resDuration.at(i);
+        resource.width = m_resWidth.at(i);
+        resource.height = m_resHeight.at(i);
+        item.resources << resource;
+    }
+
+    return item;
+}
+
+QString BrowseRowStore::resourceUri(int row, int resource) const
+{
+    const int i = m_firstResource.at(row) + resource;
+
+    return uri(m_resUriPrefix.at(i), m_resUriRest.at(i));
+}
+
+QString BrowseRowStore::resourceProtocolInfo(int row, int resource) const
+{
+    return m_pool->at(m_resProtocolInfo.at(m_firstResource.at(row) + resource));
+}
+
+quint32 BrowseRowStore::addString(const QString &string)
+{
+    if (string.isEmpty()) {
+        return 0;
+    }
+
+    quint32 offset = m_strings.size();
+    m_strings += string.toUtf8();
+    m_strings += '\0';
+
+    return offset;
+}
+
+QString BrowseRowStore::string(quint32 offset) const
+{
+    return QString::fromUtf8(m_strings.constData() + offset);
+}
+
+/*!
+ * \brief Store a url as its interned "scheme://authority/" and the rest.
+ *
+ * All resources of a server share the same few prefixes.
+ */
+void BrowseRowStore::addUri(const QString &uri, QVector<quint32> &prefixes, QVector<quint32> &rests)
+{
+    int end = uri.indexOf(QLatin1String("://"));
+    if (end > 0) {
+        end = uri.indexOf(QLatin1Char('/'), end + 3);
+    }
+
+    if (end < 0) {
+        prefixes << 0;
+        rests << addString(uri);
+    } else {
+        prefixes << m_pool->intern(uri.left(end + 1));
+        rests << addString(uri.mid(end + 1));
+    }
+}
+
+QString BrowseRowStore::uri(quint32 prefix, quint32 rest) const
+{
+    return m_pool->at(prefix) + string(rest);
+}
@@ -0,0 +1,126 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BROWSEROWSTORE_H
+#define BROWSEROWSTORE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QUrl>
+#include <QtCore/QVector>
+
+struct BrowseItem;
+
+/*!
+ * \brief Interning pool for strings repeated across rows.
+ *
+ * Holds upnp:class, artist, album, protocolInfo, icons, details and the
+ * scheme and host part of urls. Strings are never removed.
+ */
+class BrowseStringPool
+{
+public:
+    BrowseStringPool();
+
+    quint32 intern(const QString &string);
+    const QString &at(quint32 index) const { return m_strings.at(index); }
+    qint64 memoryUsage() const;
+
+private:
+    QHash<QString, quint32> m_index;
+    QVector<QString>        m_strings;
+    qint64                  m_size;
+};
+
+/*!
+ * \brief Compact storage of browse rows.
+ *
+ * Rows are kept as a structure of arrays. Strings unique to a row are stored
+ * UTF-8 encoded in a single buffer, repeated ones go through a
+ * BrowseStringPool and numbers are stored natively. The icon and details of
+ * a row are stored as computed when the BrowseItem was created, so data()
+ * does not have to derive them again.
+ */
+class BrowseRowStore
+{
+public:
+    explicit BrowseRowStore(BrowseStringPool *pool);
+
+    int count() const { return m_title.count(); }
+    void append(const BrowseItem &item);
+    void replace(int row, const BrowseItem &item);
+    void clear();
+    qint64 memoryUsage() const;
+
+    BrowseItem item(int row) const;
+    QString id(int row) const { return string(m_id.at(row)); }
+    QString title(int row) const { return string(m_title.at(row)); }
+    QString upnpClass(int row) const { return m_pool->at(m_upnpClass.at(row)); }
+    QUrl icon(int row) const { return QUrl(m_pool->at(m_icon.at(row))); }
+    QString detail(int row) const { return m_pool->at(m_detail.at(row)); }
+    int trackNumber(int row) const { return m_trackNumber.at(row); }
+    bool container(int row) const { return m_flags.at(row) & FLAG_CONTAINER; }
+    bool replaced(int row) const { return m_flags.at(row) & FLAG_REPLACED; }
+
+    int resourceCount(int row) const { return m_resourceCount.at(row); }
+    QString resourceUri(int row, int resource) const;
+    QString resourceProtocolInfo(int row, int resource) const;
+
+private:
+    enum Flags {
+        FLAG_CONTAINER = 1 << 0,
+        FLAG_RESTRICTED = 1 << 1,
+        FLAG_REPLACED = 1 << 2
+    };
+
+    quint32 addString(const QString &string);
+    QString string(quint32 offset) const;
+    void addUri(const QString &uri, QVector<quint32> &prefixes, QVector<quint32> &rests);
+    void addResources(const BrowseItem &item);
+    QString uri(quint32 prefix, quint32 rest) const;
+
+    BrowseStringPool *m_pool;
+    QByteArray        m_strings;
+
+    // rows; offsets into m_strings or indices into m_pool
+    QVector<quint32>  m_id;
+    QVector<quint32>  m_parentId;
+    QVector<quint32>  m_title;
+    QVector<quint32>  m_upnpClass;
+    QVector<quint32>  m_artist;
+    QVector<quint32>  m_album;
+    QVector<quint32>  m_albumArtPrefix;
+    QVector<quint32>  m_albumArtRest;
+    QVector<quint32>  m_icon;
+    QVector<quint32>  m_detail;
+    QVector<qint32>   m_trackNumber;
+    QVector<quint8>   m_flags;
+    QVector<quint32>  m_firstResource;
+    QVector<quint16>  m_resourceCount;
+
+    // resources of all rows
+    QVector<quint32>  m_resUriPrefix;
+    QVector<quint32>  m_resUriRest;
+    QVector<quint32>  m_resProtocolInfo;
+    QVector<qint64>   m_resSize;
+    QVector<qint32>   m_resDuration;
+    QVector<quint16>  m_resWidth;
+    QVector<quint16>  m_resHeight;
+};
+
+#endif // BROWSEROWSTORE_H
@@ -0,0 +1,262 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+
+#include "browsescheduler.h"
+#include "serviceproxycall.h"
+
+const int BrowseScheduler::DEFAULT_MAX_RUNNING = 4;
+
+QHash<QString, BrowseScheduler *> BrowseScheduler::m_schedulers;
+
+BrowseScheduler::BrowseScheduler()
+    : QObject(0)
+    , m_running()
+    , m_maxRunning(DEFAULT_MAX_RUNNING)
+{
+}
+
+/*!
+ * \brief Get the scheduler of a server.
+ *
+ * Like BrowseSliceSizer, the scheduler lives for the rest of the
+ * application.
+ *
+ * \param udn UDN of the server
+ * \return the scheduler for the server.
+ */
+BrowseScheduler *BrowseScheduler::forServer(const QString &udn)
+{
+    BrowseScheduler *scheduler = m_schedulers.value(udn);
+
+    if (scheduler == 0) {
+        scheduler = new BrowseScheduler;
+        m_schedulers.insert(udn, scheduler);
+    }
+
+    return scheduler;
+}
+
+void BrowseScheduler::setMaxRunning(int maxRunning)
+{
+    m_maxRunning = qMax(2, maxRunning);
+    startCalls();
+}
+
+/*!
+ * \brief Queue a call; it is started once no call of a higher priority waits.
+ *
+ * The caller keeps ownership and connects to ready() as usual, but has to
+ * cancel the call through cancel().
+ *
+ * \param call the prepared call
+ * \param priority what the call is for
+ */
+void BrowseScheduler::run(ServiceProxyCall *call, Priority priority)
+{
+    // Running a call again restarts it, as ServiceProxyCall::run() does
+    dequeue(call);
+    m_running.remove(call);
+
+    connect(call, SIGNAL(destroyed(QObject*)), SLOT(onCallDestroyed(QObject*)), Qt::UniqueConnection);
+    m_queues[priority] << call;
+
+    // The user is waiting for this one, e.g. after navigating
+    if (priority == PriorityVisible) {
+        preempt();
+    } else {
+        startCalls();
+    }
+}
+
+/*!
+ * \brief Cancel a queued or running call.
+ *
+ * A queued call is just dropped; a running one is cancelled and emits
+ * ready() as usual.
+ */
+void BrowseScheduler::cancel(ServiceProxyCall *call)
+{
+    disconnect(call, 0, this, 0);
+    if (dequeue(call)) {
+        return;
+    }
+
+    if (m_running.remove(call) > 0) {
+        call->cancel();
+        startCalls();
+    }
+}
+
+/*!
+ * \brief Move a queued call to another priority.
+ *
+ * The priority of a running call is only taken into account by preempt().
+ * A queued call keeps its place if its priority did not change.
+ */
+void BrowseScheduler::setPriority(ServiceProxyCall *call, Priority priority)
+{
+    if (m_running.contains(call)) {
+        m_running.insert(call, priority);
+
+        return;
+    }
+
+    const int queued = queuedPriority(call);
+    if (queued < 0 || queued == priority) {
+        return;
+    }
+
+    m_queues[queued].removeOne(call);
+    m_queues[priority] << call;
+
+    // Only a call which just became visible is worth stopping others for
+    if (priority == PriorityVisible) {
+        preempt();
+    } else {
+        startCalls();
+    }
+}
+
+/*!
+ * \brief Put all running background calls back at the front of their queue.
+ *
+ * They are started again once no call for the visible rows is left.
+ */
+void BrowseScheduler::preempt()
+{
+    int preempted = 0;
+
+    Q_FOREACH(ServiceProxyCall *call, m_running.keys()) {
+        if (isBackground(m_running.value(call)) && requeue(call)) {
+            preempted++;
+        }
+    }
+
+    if (preempted > 0) {
+        qDebug() << "Preempted" << preempted << "background calls";
+    }
+
+    startCalls();
+}
+
+/*!
+ * \brief Stop a running call and put it at the front of its queue.
+ *
+ * The owner of the call does not notice; it keeps waiting for the reply of
+ * the call run again later.
+ *
+ * \return false if the reply of the call is in already.
+ */
+bool BrowseScheduler::requeue(ServiceProxyCall *call)
+{
+    if (call->elapsed() >= 0) {
+        return false;
+    }
+
+    const int priority = m_running.take(call);
+
+    disconnect(call, SIGNAL(ready()), this, SLOT(onCallReady()));
+    call->blockSignals(true);
+    call->cancel();
+    call->blockSignals(false);
+    m_queues[priority].prepend(call);
+
+    return true;
+}
+
+bool BrowseScheduler::dequeue(ServiceProxyCall *call)
+{
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        if (m_queues[i].removeOne(call)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*!
+ * \return the priority of the queue holding call or -1 if it is not queued.
+ */
+int BrowseScheduler::queuedPriority(ServiceProxyCall *call) const
+{
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        if (m_queues[i].contains(call)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int BrowseScheduler::runningCount(int priority) const
+{
+    int count = 0;
+
+    Q_FOREACH(int running, m_running) {
+        count += running == priority ? 1 : 0;
+    }
+
+    return count;
+}
+
+void BrowseScheduler::startCalls()
+{
+    // Background calls wait while the user waits
+    const bool visible = not m_queues[PriorityVisible].isEmpty() ||
+                         runningCount(PriorityVisible) > 0;
+
+    for (int i = 0; i < PRIORITY_COUNT && not (visible && isBackground(i)); i++) {
+        // Keep a slot free for calls of the visible rows
+        const int limit = isBackground(i) ? m_maxRunning - 1 : m_maxRunning;
+
+        while (m_running.count() < limit && not m_queues[i].isEmpty()) {
+            ServiceProxyCall *call = m_queues[i].takeFirst();
+
+            m_running.insert(call, i);
+            connect(call, SIGNAL(ready()), SLOT(onCallReady()), Qt::UniqueConnection);
+            call->run();
+        }
+    }
+}
+
+void BrowseScheduler::onCallReady()
+{
+    auto call = qobject_cast<ServiceProxyCall *>(sender());
+
+    if (call == 0) {
+        return;
+    }
+
+    disconnect(call, SIGNAL(ready()), this, SLOT(onCallReady()));
+    m_running.remove(call);
+    startCalls();
+}
+
+void BrowseScheduler::onCallDestroyed(QObject *object)
+{
+    // Only the address is used, the call is gone already
+    auto call = static_cast<ServiceProxyCall *>(object);
+
+    if (not dequeue(call) && m_running.remove(call) == 0) {
+        return;
+    }
+
+    startCalls();
+}
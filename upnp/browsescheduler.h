@@ -0,0 +1,84 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BROWSESCHEDULER_H
+#define BROWSESCHEDULER_H
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+class ServiceProxyCall;
+
+/*!
+ * \brief Per-server queue of Browse calls ordered by what the user sees.
+ *
+ * Calls are started in order of their priority, at most maxRunning() at a
+ * time. Background calls never take the last free slot and do not start
+ * while calls for the visible rows are waiting or running. A new call for
+ * the visible rows, as after navigating, preempts running background calls:
+ * they are put back into their queue and run again later.
+ */
+class BrowseScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    enum Priority {
+        PriorityVisible,
+        PriorityLookahead,
+        PriorityPrefetch,
+        PriorityCrawl
+    };
+
+    static const int DEFAULT_MAX_RUNNING;
+
+    static BrowseScheduler *forServer(const QString &udn);
+
+    void run(ServiceProxyCall *call, Priority priority);
+    void cancel(ServiceProxyCall *call);
+    void setPriority(ServiceProxyCall *call, Priority priority);
+    void preempt();
+
+    int maxRunning() const { return m_maxRunning; }
+    void setMaxRunning(int maxRunning);
+
+private Q_SLOTS:
+    void onCallReady();
+    void onCallDestroyed(QObject *object);
+
+private:
+    static const int PRIORITY_COUNT = PriorityCrawl + 1;
+
+    explicit BrowseScheduler();
+
+    static QHash<QString, BrowseScheduler *> m_schedulers;
+
+    static bool isBackground(int priority) { return priority >= PriorityPrefetch; }
+    bool dequeue(ServiceProxyCall *call);
+    int queuedPriority(ServiceProxyCall *call) const;
+    bool requeue(ServiceProxyCall *call);
+    int runningCount(int priority) const;
+    void startCalls();
+
+    QList<ServiceProxyCall *>      m_queues[PRIORITY_COUNT];
+    // running calls and their priority
+    QHash<ServiceProxyCall *, int> m_running;
+    int                            m_maxRunning;
+};
+
+#endif // BROWSESCHEDULER_H
@@ -0,0 +1,136 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <limits.h>
+
+#include <QDebug>
+
+#include "browseslicesizer.h"
+
+// Time a single Browse call should take
+const double TARGET_LATENCY = 400.0;
+
+// Upper bound for a single Result, parsing bigger documents stalls the UI
+const double TARGET_RESULT_SIZE = 512.0 * 1024.0;
+
+// Weight of the newest measurement in the running averages
+const double SMOOTHING = 0.5;
+
+// Full replies at the server limit before asking for more again
+const int PROBE_INTERVAL = 8;
+
+const unsigned int BrowseSliceSizer::DEFAULT_SLICE = 100;
+
+QHash<QString, BrowseSliceSizer *> BrowseSliceSizer::m_sizers;
+
+BrowseSliceSizer::BrowseSliceSizer()
+    : m_sliceSize(DEFAULT_SLICE)
+    , m_minimum(10)
+    , m_maximum(500)
+    , m_serverLimit(UINT_MAX)
+    , m_fullReplies(0)
+    , m_msPerObject(0.0)
+    , m_bytesPerObject(0.0)
+{
+}
+
+/*!
+ * \brief Get the slice sizer of a server.
+ *
+ * The sizer lives for the rest of the application so its measurements
+ * survive re-selecting the server.
+ *
+ * \param udn UDN of the server
+ * \return the sizer for the server.
+ */
+BrowseSliceSizer *BrowseSliceSizer::forServer(const QString &udn)
+{
+    BrowseSliceSizer *sizer = m_sizers.value(udn);
+
+    if (sizer == 0) {
+        sizer = new BrowseSliceSizer;
+        m_sizers.insert(udn, sizer);
+    }
+
+    return sizer;
+}
+
+void BrowseSliceSizer::setLimits(unsigned int minimum, unsigned int maximum)
+{
+    m_minimum = minimum;
+    m_maximum = qMax(minimum, maximum);
+    m_sliceSize = qBound(m_minimum, m_sliceSize, m_maximum);
+}
+
+/*!
+ * \brief Feed the result of a finished Browse call.
+ *
+ * \param requested RequestedCount of the call
+ * \param returned NumberReturned of the call
+ * \param lastSlice whether the call reached the end of the container
+ * \param elapsed round-trip time of the call in milliseconds
+ * \param resultSize size of the Result DIDL-Lite document
+ */
+void BrowseSliceSizer::update(unsigned int requested,
+                              unsigned int returned,
+                              bool         lastSlice,
+                              qint64       elapsed,
+                              int          resultSize)
+{
+    if (returned == 0 || elapsed < 0) {
+        return;
+    }
+
+    // Server has an internal limit; asking for more only causes extra calls
+    // to fill the gaps. It might just have dropped objects it could not
+    // serialize though, so the limit is probed again after a while.
+    if (returned < requested && not lastSlice) {
+        m_serverLimit = qMax(m_minimum, returned);
+        m_fullReplies = 0;
+    } else if (returned == requested && requested >= m_serverLimit &&
+               m_serverLimit < m_maximum && ++m_fullReplies >= PROBE_INTERVAL) {
+        m_serverLimit = m_serverLimit > m_maximum / 2 ? UINT_MAX : m_serverLimit * 2;
+        m_fullReplies = 0;
+        qDebug() << "Probing browse slices above the server limit";
+    }
+
+    double msPerObject = double(elapsed) / returned;
+    double bytesPerObject = double(resultSize) / returned;
+
+    if (m_msPerObject == 0.0) {
+        m_msPerObject = msPerObject;
+        m_bytesPerObject = bytesPerObject;
+    } else {
+        m_msPerObject += SMOOTHING * (msPerObject - m_msPerObject);
+        m_bytesPerObject += SMOOTHING * (bytesPerObject - m_bytesPerObject);
+    }
+
+    double size = TARGET_LATENCY / qMax(m_msPerObject, 0.01);
+    if (m_bytesPerObject > 0.0) {
+        size = qMin(size, TARGET_RESULT_SIZE / m_bytesPerObject);
+    }
+
+    // Grow carefully, shrink immediately
+    unsigned int newSize = qMin(unsigned(size), m_sliceSize * 2);
+    newSize = qBound(m_minimum, newSize, qMin(m_maximum, m_serverLimit));
+
+    if (newSize != m_sliceSize) {
+        qDebug() << "Adjusting browse slice from" << m_sliceSize << "to" << newSize
+                 << "(" << m_msPerObject << "ms," << m_bytesPerObject << "bytes per object)";
+        m_sliceSize = newSize;
+    }
+}
@@ -0,0 +1,62 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BROWSESLICESIZER_H
+#define BROWSESLICESIZER_H
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+/*!
+ * \brief Per-server RequestedCount for Browse calls.
+ *
+ * Tracks the time and Result size per object of the Browse calls done on a
+ * server and derives the slice size from it, within the server's limits.
+ * A limit learned from a short reply is raised again after a run of full
+ * replies, as servers also return less when they skip objects.
+ */
+class BrowseSliceSizer
+{
+public:
+    static const unsigned int DEFAULT_SLICE;
+
+    static BrowseSliceSizer *forServer(const QString &udn);
+
+    unsigned int sliceSize() const { return m_sliceSize; }
+    void setLimits(unsigned int minimum, unsigned int maximum);
+    void update(unsigned int requested,
+                unsigned int returned,
+                bool         lastSlice,
+                qint64       elapsed,
+                int          resultSize);
+
+private:
+    BrowseSliceSizer();
+
+    static QHash<QString, BrowseSliceSizer *> m_sizers;
+
+    unsigned int m_sliceSize;
+    unsigned int m_minimum;
+    unsigned int m_maximum;
+    // NumberReturned of the last short reply, raised by full replies
+    unsigned int m_serverLimit;
+    int          m_fullReplies;
+    double       m_msPerObject;
+    double       m_bytesPerObject;
+};
+
+#endif // BROWSESLICESIZER_H
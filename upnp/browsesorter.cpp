@@ -0,0 +1,174 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <limits.h>
+#include <wchar.h>
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include "browsemodel.h"
+#include "browsesorter.h"
+
+QThread BrowseSorter::sorterThread;
+
+class BrowseSorter::KeyLess
+{
+public:
+    explicit KeyLess(const QVector<Key> &keys)
+        : m_keys(keys)
+    {
+    }
+
+    bool operator()(int a, int b) const
+    {
+        const Key &left = m_keys.at(a);
+        const Key &right = m_keys.at(b);
+
+        if (left.upnpClass != right.upnpClass) {
+            return left.upnpClass < right.upnpClass;
+        }
+
+        if (left.trackNumber != right.trackNumber) {
+            return left.trackNumber < right.trackNumber;
+        }
+
+        return left.title < right.title;
+    }
+
+private:
+    const QVector<Key> &m_keys;
+};
+
+BrowseSorter::BrowseSorter()
+    : QObject(0)
+    , m_generation(-1)
+    , m_keys()
+    , m_order()
+{
+    moveToThread(&BrowseSorter::sorterThread);
+    if (not BrowseSorter::sorterThread.isRunning()) {
+        qRegisterMetaType<QVector<int> >("QVector<int>");
+
+        qAddPostRoutine(BrowseSorter::stopSorterThread);
+        BrowseSorter::sorterThread.start(QThread::LowPriority);
+    }
+}
+
+/*!
+ * \brief Stop the sorter thread and wait for it to finish.
+ *
+ * Runs when the application object is destroyed, so the thread is joined
+ * before the static QThread itself goes away.
+ */
+void BrowseSorter::stopSorterThread()
+{
+    BrowseSorter::sorterThread.quit();
+    BrowseSorter::sorterThread.wait();
+}
+
+/*!
+ * \brief Create a key that compares like the title in the current locale.
+ *
+ * QCoreApplication sets the C locale from the environment, so wcsxfrm()
+ * collates the same way QString::localeAwareCompare() does, without having
+ * to compare the titles again for every comparison.
+ */
+std::wstring BrowseSorter::collationKey(const QString &title)
+{
+    const std::wstring text = title.toStdWString();
+    const size_t length = wcsxfrm(0, text.c_str(), 0);
+    std::wstring key(length + 1, L'\0');
+
+    wcsxfrm(&key[0], text.c_str(), length + 1);
+    key.resize(length);
+
+    return key;
+}
+
+/*!
+ * \brief Sort a batch of rows into the rows sorted before.
+ *
+ * Emits sorted() with the order of all rows passed so far.
+ *
+ * \param generation rows of a different generation than the last call are
+ *        dropped; a new generation has to start at row 0
+ * \param mode a BrowseModel::LocalSort
+ * \param first index of the first row of the batch
+ * \param titles titles of the rows of the batch
+ * \param classes upnp:class of the rows of the batch
+ * \param trackNumbers upnp:originalTrackNumber of the rows of the batch,
+ *        -1 if they do not have one
+ */
+void BrowseSorter::sort(int generation,
+                        int mode,
+                        int first,
+                        const QStringList &titles,
+                        const QStringList &classes,
+                        const QVector<int> &trackNumbers)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    if (generation != m_generation) {
+        m_generation = generation;
+        m_keys.clear();
+        m_order.clear();
+    }
+
+    if (first != m_keys.count()) {
+        qWarning() << "Sort batch starts at" << first << "instead of" << m_keys.count();
+
+        return;
+    }
+
+    QVector<int> batch;
+    batch.reserve(titles.count());
+    m_keys.reserve(first + titles.count());
+    for (int i = 0; i < titles.count(); i++) {
+        Key key;
+
+        if (mode == BrowseModel::SortByClassAndTitle) {
+            key.upnpClass = classes.at(i);
+            key.trackNumber = 0;
+        } else {
+            // Tracks without a number go last
+            key.trackNumber = trackNumbers.at(i) < 0 ? INT_MAX : trackNumbers.at(i);
+        }
+        key.title = collationKey(titles.at(i));
+        m_keys << key;
+        batch << first + i;
+    }
+
+    // Both steps are stable, equal rows keep the server's order
+    const KeyLess lessThan(m_keys);
+    std::stable_sort(batch.begin(), batch.end(), lessThan);
+
+    QVector<int> order(m_order.count() + batch.count());
+    std::merge(m_order.constBegin(), m_order.constEnd(),
+               batch.constBegin(), batch.constEnd(),
+               order.begin(), lessThan);
+    m_order = order;
+
+    qint64 elapsed = timer.elapsed();
+    qDebug() << "Sorted" << batch.count() << "rows into" << m_order.count()
+             << "rows in" << elapsed << "ms";
+
+    Q_EMIT sorted(generation, m_order, elapsed);
+}
@@ -0,0 +1,73 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BROWSESORTER_H
+#define BROWSESORTER_H
+
+#include <string>
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+/*!
+ * \brief Sorts the rows of a BrowseModel on a worker thread.
+ *
+ * Used for servers that cannot sort by the criteria Helium asks for. Like
+ * BrowseResultParser, each model owns one sorter object living on a thread
+ * shared by all sorters. Rows are passed in batches with sort(); the sort
+ * key of a row is built once and kept, so every later batch is only sorted
+ * by itself and merged into the rows sorted before.
+ */
+class BrowseSorter : public QObject
+{
+    Q_OBJECT
+    static QThread sorterThread;
+    static void stopSorterThread();
+public:
+    explicit BrowseSorter();
+
+public Q_SLOTS:
+    void sort(int generation,
+              int mode,
+              int first,
+              const QStringList &titles,
+              const QStringList &classes,
+              const QVector<int> &trackNumbers);
+
+Q_SIGNALS:
+    void sorted(int generation, const QVector<int> &order, qint64 elapsed);
+
+private:
+    struct Key {
+        QString      upnpClass;
+        int          trackNumber;
+        std::wstring title;
+    };
+
+    class KeyLess;
+
+    static std::wstring collationKey(const QString &title);
+
+    int          m_generation;
+    QVector<Key> m_keys;
+    QVector<int> m_order;
+};
+
+#endif // BROWSESORTER_H
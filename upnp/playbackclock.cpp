@@ -0,0 +1,178 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+
+#include "playbackclock.h"
+
+const int PlaybackClock::MIN_RESYNC_INTERVAL = 1000;
+const int PlaybackClock::MAX_RESYNC_INTERVAL = 30000;
+
+// RelTime usually only has a resolution of a second
+const int PlaybackClock::MAX_DRIFT = 1000;
+
+// Steps a progress bar is assumed to have; ticks are not more frequent
+// than it takes to move a step, nor than a display frame or a second
+const int PROGRESS_STEPS = 500;
+const int MIN_TICK_INTERVAL = 16;
+const int MAX_TICK_INTERVAL = 1000;
+
+PlaybackClock::PlaybackClock(QObject *parent)
+    : QObject(parent)
+    , m_sinceSync()
+    , m_base(0)
+    , m_duration(0)
+    , m_running(false)
+    , m_resyncInterval(MIN_RESYNC_INTERVAL)
+    , m_resyncs(0)
+    , m_tickTimer()
+    , m_resyncTimer()
+{
+    m_tickTimer.setInterval(MAX_TICK_INTERVAL);
+    connect(&m_tickTimer, SIGNAL(timeout()), SIGNAL(tick()));
+
+    m_resyncTimer.setSingleShot(true);
+    connect(&m_resyncTimer, SIGNAL(timeout()), SLOT(onResyncTimeout()));
+}
+
+/*!
+ * \brief The estimated position in milliseconds.
+ */
+qint64 PlaybackClock::position() const
+{
+    qint64 position = m_base;
+
+    if (m_running && m_sinceSync.isValid()) {
+        position += m_sinceSync.elapsed();
+    }
+
+    if (m_duration > 0) {
+        position = qMin(position, m_duration);
+    }
+
+    return position;
+}
+
+void PlaybackClock::setRunning(bool running)
+{
+    if (running == m_running) {
+        return;
+    }
+
+    m_base = position();
+    m_sinceSync.restart();
+    m_running = running;
+
+    if (m_running) {
+        m_tickTimer.start();
+    } else {
+        m_tickTimer.stop();
+        m_resyncTimer.stop();
+        Q_EMIT tick();
+    }
+}
+
+/*!
+ * \brief Set the duration of the track in milliseconds, 0 if unknown.
+ */
+void PlaybackClock::setDuration(qint64 duration)
+{
+    m_duration = duration;
+    m_tickTimer.setInterval(duration > 0 ? qBound(qint64(MIN_TICK_INTERVAL),
+                                                  duration / PROGRESS_STEPS,
+                                                  qint64(MAX_TICK_INTERVAL))
+                                         : MAX_TICK_INTERVAL);
+}
+
+/*!
+ * \brief Correct the clock with the position the renderer reported.
+ *
+ * The next resync is twice as far away if the estimate was good enough
+ * and as near as possible otherwise.
+ *
+ * \param position the renderer's position in milliseconds
+ */
+void PlaybackClock::sync(qint64 position)
+{
+    const qint64 drift = qAbs(this->position() - position);
+
+    m_base = position;
+    m_sinceSync.restart();
+    Q_EMIT tick();
+
+    if (not m_running) {
+        return;
+    }
+
+    if (drift < MAX_DRIFT) {
+        m_resyncInterval = qMin(m_resyncInterval * 2, MAX_RESYNC_INTERVAL);
+    } else {
+        m_resyncInterval = MIN_RESYNC_INTERVAL;
+    }
+    qDebug() << "Playback clock drifted" << drift << "ms, next resync in"
+             << m_resyncInterval << "ms," << m_resyncs << "resyncs so far";
+    m_resyncTimer.start(m_resyncInterval);
+}
+
+/*!
+ * \brief Jump to the position a Seek was sent for.
+ * \param position the target of the seek in milliseconds
+ */
+void PlaybackClock::seek(qint64 position)
+{
+    m_base = position;
+    m_sinceSync.restart();
+    m_resyncInterval = MIN_RESYNC_INTERVAL;
+    if (m_running) {
+        m_resyncTimer.start(m_resyncInterval);
+    }
+    Q_EMIT tick();
+}
+
+/*!
+ * \brief Stop the clock at the start of the track.
+ */
+void PlaybackClock::reset()
+{
+    setRunning(false);
+    m_base = 0;
+    m_resyncInterval = MIN_RESYNC_INTERVAL;
+    Q_EMIT tick();
+}
+
+/*!
+ * \brief Ask for the renderer's position right away.
+ *
+ * Used whenever the renderer announced a change of its transport, after
+ * which the estimate can not be trusted.
+ */
+void PlaybackClock::resync()
+{
+    m_resyncInterval = MIN_RESYNC_INTERVAL;
+    onResyncTimeout();
+}
+
+void PlaybackClock::onResyncTimeout()
+{
+    m_resyncs++;
+
+    // In case the answer never comes; sync() restarts the timer otherwise
+    if (m_running) {
+        m_resyncTimer.start(m_resyncInterval);
+    }
+    Q_EMIT resyncRequested();
+}
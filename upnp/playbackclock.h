@@ -0,0 +1,71 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PLAYBACKCLOCK_H
+#define PLAYBACKCLOCK_H
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+
+/*!
+ * \brief Local estimate of a renderer's playback position.
+ *
+ * The position is extrapolated from the last one the renderer reported.
+ * resyncRequested() asks for the real position, soon after playback
+ * started or jumped and more and more rarely while the estimate keeps
+ * matching the renderer.
+ */
+class PlaybackClock : public QObject
+{
+    Q_OBJECT
+public:
+    static const int MIN_RESYNC_INTERVAL;
+    static const int MAX_RESYNC_INTERVAL;
+    static const int MAX_DRIFT;
+
+    explicit PlaybackClock(QObject *parent = 0);
+
+    qint64 position() const;
+    bool running() const { return m_running; }
+    void setRunning(bool running);
+    void setDuration(qint64 duration);
+
+    void sync(qint64 position);
+    void seek(qint64 position);
+    void reset();
+    void resync();
+
+Q_SIGNALS:
+    void tick();
+    void resyncRequested();
+
+private Q_SLOTS:
+    void onResyncTimeout();
+
+private:
+    QElapsedTimer m_sinceSync;
+    qint64        m_base;
+    qint64        m_duration;
+    bool          m_running;
+    int           m_resyncInterval;
+    int           m_resyncs;
+    QTimer        m_tickTimer;
+    QTimer        m_resyncTimer;
+};
+
+#endif // PLAYBACKCLOCK_H
@@ -0,0 +1,574 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <QStringList>
+
+#include "browsecrawler.h"
+#include "browsemodel.h"
+#include "browsemodel_p.h"
+#include "browsescheduler.h"
+#include "didllitestreamparser.h"
+#include "playbackqueue.h"
+#include "serviceproxycall.h"
+#include "upnprenderer.h"
+
+const int PlaybackQueue::PREFETCH = 3;
+
+// Every entry keeps a copy of its row until the uri is chosen
+const int PlaybackQueue::MAX_ENTRIES = 500;
+
+PlaybackQueue::PlaybackQueue(UPnPRenderer *renderer)
+    : QObject(renderer)
+    , m_renderer(renderer)
+    , m_entries()
+    , m_matcher()
+    , m_browseCall(0)
+    , m_metaDataCall(0)
+    , m_scheduler(0)
+    , m_crawler(0)
+    , m_calls()
+    , m_current(-1)
+    , m_handedOver(-1)
+    , m_gapless(false)
+    , m_advancing(false)
+    , m_switching(false)
+    , m_waiting(false)
+{
+    connect(m_renderer, SIGNAL(stateChanged()), SLOT(onStateChanged()));
+    connect(m_renderer, SIGNAL(trackUriChanged()), SLOT(onTrackUriChanged()));
+}
+
+PlaybackQueue::~PlaybackQueue()
+{
+    cancelCalls();
+}
+
+/*!
+ * \brief Play the items of a model, starting with row.
+ *
+ * Rows are taken as the view shows them; containers are left out. The uri
+ * of an item is chosen for the renderer's protocolInfo when the item is
+ * about to be played.
+ */
+void PlaybackQueue::playFrom(BrowseModel *model, int row)
+{
+    clear();
+    if (model == 0) {
+        return;
+    }
+
+    auto source = qobject_cast<BrowseModelPrivate *>(model->sourceModel());
+    if (source == 0) {
+        return;
+    }
+
+    m_matcher = ProtocolInfoMatcher(m_renderer->protocolInfo());
+    m_scheduler = BrowseScheduler::forServer(model->udn());
+    if (source->call() != 0) {
+        m_browseCall = source->call()->clone(this);
+    }
+
+    if (source->metaDataCall() != 0) {
+        m_metaDataCall = source->metaDataCall()->clone(this);
+
+        // Rows fetched by position need all properties, too
+        if (m_browseCall != 0) {
+            m_browseCall->setArg(QLatin1String("Filter"),
+                                 m_metaDataCall->arg(QLatin1String("Filter")));
+        }
+    }
+
+    for (int i = row; i < model->rowCount() && m_entries.count() < MAX_ENTRIES; i++) {
+        const QModelIndex index = model->mapToSource(model->index(i, 0));
+        Entry entry;
+
+        switch (source->snapshotRow(index.row(), &entry.item, &entry.position)) {
+        case BrowseModelPrivate::RowContainer:
+            continue;
+        case BrowseModelPrivate::RowComplete:
+            entry.status = StatusLoaded;
+            break;
+        default:
+            entry.status = StatusUnresolved;
+            break;
+        }
+
+        entry.id = entry.item.id;
+        m_entries << entry;
+    }
+
+    qDebug() << "Queued" << m_entries.count() << "items";
+    next();
+}
+
+/*!
+ * \brief Play the items a crawler finds, in the order it finds them.
+ *
+ * The first item is started as soon as it is found. Crawling stops when
+ * MAX_ENTRIES items are queued.
+ *
+ * \param crawler a running crawler; the queue takes ownership
+ */
+void PlaybackQueue::playCrawl(BrowseCrawler *crawler)
+{
+    clear();
+    if (crawler == 0) {
+        return;
+    }
+
+    m_matcher = ProtocolInfoMatcher(m_renderer->protocolInfo());
+    m_crawler = crawler;
+    m_crawler->setParent(this);
+
+    // The user waits for the first item; don't wait for browsing to finish
+    m_crawler->setPriority(BrowseScheduler::PriorityLookahead);
+    connect(m_crawler, SIGNAL(itemsFound(BrowseItemList)), SLOT(onItemsFound(BrowseItemList)));
+    connect(m_crawler, SIGNAL(finished()), SLOT(onCrawlFinished()));
+
+    // Started by the first items found
+    m_advancing = true;
+    m_waiting = true;
+}
+
+void PlaybackQueue::clear()
+{
+    cancelCalls();
+    if (m_crawler != 0) {
+        m_crawler->disconnect(this);
+        m_crawler->cancel();
+        m_crawler->deleteLater();
+        m_crawler = 0;
+    }
+
+    delete m_browseCall;
+    m_browseCall = 0;
+    delete m_metaDataCall;
+    m_metaDataCall = 0;
+    m_scheduler = 0;
+
+    m_entries.clear();
+    m_current = m_handedOver = -1;
+    m_advancing = false;
+    m_switching = false;
+    m_waiting = false;
+}
+
+/*!
+ * \brief Start the item after the current one.
+ *
+ * If that item still has to be fetched, it is started once it arrived.
+ *
+ * \return false if there is none the renderer can play.
+ */
+bool PlaybackQueue::next()
+{
+    if (m_entries.isEmpty()) {
+        return false;
+    }
+
+    m_advancing = true;
+
+    bool pending = false;
+    const int next = nextPlayable(m_current + 1, &pending);
+    if (next < 0 && pending) {
+        m_waiting = true;
+
+        return true;
+    }
+
+    return play(next);
+}
+
+/*!
+ * \brief Skip the current entry after the renderer refused to play it.
+ *
+ * Called by the renderer if SetAVTransportURI or Play of the entry failed.
+ * Without it, the queue would wait for PLAYING forever and ignore the end
+ * of every later item.
+ */
+void PlaybackQueue::playFailed()
+{
+    if (not m_switching) {
+        return;
+    }
+
+    m_switching = false;
+    if (m_current >= 0) {
+        m_entries[m_current].status = StatusUnplayable;
+    }
+
+    if (not next()) {
+        m_advancing = false;
+    }
+}
+
+/*!
+ * \brief Start the playable item before the current one.
+ *
+ * Items before the current one were all resolved on the way.
+ */
+bool PlaybackQueue::previous()
+{
+    for (int i = m_current - 1; i >= 0; i--) {
+        resolve(i);
+        if (m_entries.at(i).status == StatusPlayable) {
+            m_advancing = true;
+
+            return play(i);
+        }
+    }
+
+    return false;
+}
+
+/*!
+ * \brief Tell the queue whether SetNextAVTransportURI can be used.
+ */
+void PlaybackQueue::setGapless(bool gapless)
+{
+    if (gapless == m_gapless) {
+        return;
+    }
+
+    m_gapless = gapless;
+    m_handedOver = -1;
+    handOverNext();
+}
+
+/*!
+ * \brief Tell the queue whether to continue with the next item when the
+ *        renderer stops.
+ *
+ * The renderer turns this off when the user stops playback.
+ */
+void PlaybackQueue::setAdvancing(bool advancing)
+{
+    m_advancing = advancing;
+}
+
+void PlaybackQueue::onStateChanged()
+{
+    const QString state = m_renderer->state();
+
+    if (state == QLatin1String("PLAYING")) {
+        m_switching = false;
+        handOverNext();
+    } else if (state == QLatin1String("STOPPED") &&
+               m_advancing && not m_switching && m_current >= 0) {
+        // The renderer reached the end of the item on its own; the next
+        // one is resolved already, so only SetAVTransportURI and Play are
+        // left to do
+        if (not next()) {
+            m_advancing = false;
+        }
+    }
+}
+
+/*!
+ * \brief Follow the renderer to the item handed over with
+ *        SetNextAVTransportURI.
+ */
+void PlaybackQueue::onTrackUriChanged()
+{
+    if (m_handedOver < 0 || m_renderer->trackUri() != m_entries.at(m_handedOver).uri) {
+        return;
+    }
+
+    m_current = m_handedOver;
+    m_handedOver = -1;
+    resolveAhead();
+    handOverNext();
+}
+
+/*!
+ * \brief Take the items a Browse call fetched for the queue.
+ *
+ * Entries the server did not return or returned as container are skipped.
+ */
+void PlaybackQueue::onCallReady()
+{
+    auto call = qobject_cast<ServiceProxyCall *>(sender());
+    if (call == 0 || call->cancelled() || not m_calls.contains(call)) {
+        return;
+    }
+
+    call->finalize(QStringList() << QLatin1String("Result"));
+    call->deleteLater();
+
+    const QList<int> entries = m_calls.take(call);
+    BrowseItemList items;
+
+    if (call->hasError()) {
+        qDebug() << "Failed to fetch queued items" << call->errorMessage();
+    } else {
+        const QByteArray result = call->get(QLatin1String("Result")).toString().toUtf8();
+        DIDLLiteStreamParser parser;
+
+        if (parser.parse(result.constData(), result.size())) {
+            Q_FOREACH(const DIDLLiteRecord &record, parser.records()) {
+                items << BrowseModelPrivate::createItem(record, parser.resources());
+            }
+        }
+    }
+
+    const int start = call->arg(QLatin1String("StartingIndex")).toInt();
+    Q_FOREACH(int i, entries) {
+        Entry &e = m_entries[i];
+        BrowseItem item;
+
+        // BrowseMetadata for entries with an id, the rows from StartingIndex
+        // on for the others
+        if (e.id.isEmpty()) {
+            item = items.value(e.position - start);
+        } else {
+            Q_FOREACH(const BrowseItem &candidate, items) {
+                if (candidate.id == e.id) {
+                    item = candidate;
+                    break;
+                }
+            }
+        }
+
+        if (item.id.isEmpty() || item.container) {
+            e.status = StatusUnplayable;
+        } else {
+            e.id = item.id;
+            e.item = item;
+            e.status = StatusLoaded;
+        }
+        resolve(i);
+    }
+
+    continueWaiting();
+}
+
+void PlaybackQueue::onItemsFound(const BrowseItemList &items)
+{
+    Q_FOREACH(const BrowseItem &item, items) {
+        if (m_entries.count() >= MAX_ENTRIES) {
+            qDebug() << "Playback queue is full, not crawling further";
+            m_crawler->cancel();
+            onCrawlFinished();
+
+            return;
+        }
+
+        Entry entry;
+        entry.id = item.id;
+        entry.position = -1;
+        entry.item = item;
+        entry.status = StatusLoaded;
+        m_entries << entry;
+    }
+
+    continueWaiting();
+}
+
+void PlaybackQueue::onCrawlFinished()
+{
+    qDebug() << "Queued" << m_entries.count() << "items";
+    m_crawler->disconnect(this);
+    m_crawler->deleteLater();
+    m_crawler = 0;
+
+    continueWaiting();
+}
+
+/*!
+ * \brief Go on after entries were fetched or found.
+ */
+void PlaybackQueue::continueWaiting()
+{
+    if (m_waiting) {
+        m_waiting = false;
+        if (not next()) {
+            m_advancing = false;
+        }
+    } else {
+        handOverNext();
+    }
+}
+
+/*!
+ * \brief Choose the uri and metadata of a complete entry.
+ */
+void PlaybackQueue::resolve(int entry)
+{
+    Entry &e = m_entries[entry];
+
+    if (e.status != StatusLoaded) {
+        return;
+    }
+
+    e.uri = BrowseModelPrivate::compatibleUri(m_matcher, e.item);
+    if (e.uri.isEmpty()) {
+        e.status = StatusUnplayable;
+    } else {
+        e.metaData = BrowseModelPrivate::metaDataForItem(e.item);
+        e.status = StatusPlayable;
+    }
+
+    // Only the uri and metadata are needed from now on
+    e.item = BrowseItem();
+}
+
+/*!
+ * \brief Fetch an entry the model did not have complete.
+ *
+ * Entries with an id are fetched with BrowseMetadata. Entries whose rows
+ * were not loaded are fetched by their position, together with the
+ * following ones.
+ */
+void PlaybackQueue::fetch(int entry)
+{
+    Entry &e = m_entries[entry];
+
+    if (e.status != StatusUnresolved) {
+        return;
+    }
+
+    ServiceProxyCall *call = 0;
+    QList<int> entries;
+
+    if (not e.id.isEmpty() && m_metaDataCall != 0) {
+        call = m_metaDataCall->clone(this);
+        call->setArg(QLatin1String("ObjectID"), e.id);
+        entries << entry;
+    } else if (e.id.isEmpty() && m_browseCall != 0) {
+        const int end = e.position + PREFETCH + 1;
+
+        call = m_browseCall->clone(this);
+        call->setArg(QLatin1String("StartingIndex"), guint(e.position));
+        call->setArg(QLatin1String("RequestedCount"), guint(PREFETCH + 1));
+        for (int i = entry; i < m_entries.count() && m_entries.at(i).position < end; i++) {
+            if (m_entries.at(i).status == StatusUnresolved && m_entries.at(i).id.isEmpty()) {
+                entries << i;
+            }
+        }
+    } else {
+        e.status = StatusUnplayable;
+
+        return;
+    }
+
+    Q_FOREACH(int i, entries) {
+        m_entries[i].status = StatusResolving;
+    }
+
+    connect(call, SIGNAL(ready()), SLOT(onCallReady()));
+    m_calls.insert(call, entries);
+    m_scheduler->run(call, BrowseScheduler::PriorityLookahead);
+}
+
+/*!
+ * \brief Make sure the next PREFETCH playable entries are on their way.
+ */
+void PlaybackQueue::resolveAhead()
+{
+    int ahead = 0;
+
+    for (int i = m_current + 1; i < m_entries.count() && ahead < PREFETCH; i++) {
+        resolve(i);
+        fetch(i);
+        if (m_entries.at(i).status != StatusUnplayable) {
+            ahead++;
+        }
+    }
+}
+
+/*!
+ * \brief The first playable entry from entry on.
+ *
+ * \param pending set if an entry before the first playable one is still
+ *        being fetched, or more entries can still be found
+ * \return the entry or -1 if there is none yet.
+ */
+int PlaybackQueue::nextPlayable(int entry, bool *pending)
+{
+    *pending = m_crawler != 0;
+
+    for (int i = entry; i < m_entries.count(); i++) {
+        resolve(i);
+
+        const Status status = m_entries.at(i).status;
+        if (status == StatusPlayable) {
+            return i;
+        }
+
+        if (status != StatusUnplayable) {
+            fetch(i);
+            *pending = true;
+
+            return -1;
+        }
+    }
+
+    return -1;
+}
+
+bool PlaybackQueue::play(int entry)
+{
+    if (entry < 0 || entry >= m_entries.count() ||
+        m_entries.at(entry).status != StatusPlayable) {
+        return false;
+    }
+
+    m_current = entry;
+    m_handedOver = -1;
+    m_switching = true;
+    m_waiting = false;
+    m_renderer->playQueued(m_entries.at(entry).uri, m_entries.at(entry).metaData);
+    resolveAhead();
+
+    return true;
+}
+
+/*!
+ * \brief Give the renderer the next item with SetNextAVTransportURI.
+ *
+ * Done once the current item plays, so renderers that reset the next uri
+ * on SetAVTransportURI keep it.
+ */
+void PlaybackQueue::handOverNext()
+{
+    if (not m_gapless || m_current < 0 || m_switching ||
+        m_renderer->state() != QLatin1String("PLAYING")) {
+        return;
+    }
+
+    bool pending = false;
+    const int next = nextPlayable(m_current + 1, &pending);
+    if (next < 0 || next == m_handedOver) {
+        return;
+    }
+
+    m_handedOver = next;
+    m_renderer->setNextAVTransportUri(m_entries.at(next).uri, m_entries.at(next).metaData);
+}
+
+void PlaybackQueue::cancelCalls()
+{
+    QList<ServiceProxyCall *> calls = m_calls.keys();
+
+    m_calls.clear();
+    Q_FOREACH(ServiceProxyCall *call, calls) {
+        call->disconnect(this);
+        m_scheduler->cancel(call);
+        call->deleteLater();
+    }
+}
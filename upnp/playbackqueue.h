@@ -0,0 +1,131 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PLAYBACKQUEUE_H
+#define PLAYBACKQUEUE_H
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+
+#include "browsemodel_p.h"
+#include "protocolinfomatcher.h"
+
+class BrowseCrawler;
+class BrowseModel;
+class BrowseScheduler;
+class ServiceProxyCall;
+class UPnPRenderer;
+
+/*!
+ * \brief The items a renderer plays one after the other.
+ *
+ * The queue copies what it needs of the rows when it is filled, so it keeps
+ * playing when the rows are filtered out of the view, evicted or the model
+ * is deleted. Rows the model had not loaded, or loaded without their
+ * resources, are fetched from the server with Browse calls of their own,
+ * PREFETCH items ahead of the current one. If the renderer has
+ * SetNextAVTransportURI, the next item is handed to it as soon as the
+ * current one plays, so it can switch without a gap. Otherwise the next
+ * item is started as soon as the renderer stopped at the end of the current
+ * one.
+ *
+ * Alternatively, the queue is filled by a BrowseCrawler with the items of a
+ * container and all containers below it, while the first ones play.
+ */
+class PlaybackQueue : public QObject
+{
+    Q_OBJECT
+public:
+    static const int PREFETCH;
+    static const int MAX_ENTRIES;
+
+    explicit PlaybackQueue(UPnPRenderer *renderer);
+    ~PlaybackQueue();
+
+    void playFrom(BrowseModel *model, int row);
+    void playCrawl(BrowseCrawler *crawler);
+    void clear();
+    bool next();
+    bool previous();
+    void playFailed();
+
+    int count() const { return m_entries.count(); }
+    int current() const { return m_current; }
+    bool gapless() const { return m_gapless; }
+    void setGapless(bool gapless);
+    void setAdvancing(bool advancing);
+
+private Q_SLOTS:
+    void onStateChanged();
+    void onTrackUriChanged();
+    void onCallReady();
+    void onItemsFound(const BrowseItemList &items);
+    void onCrawlFinished();
+
+private:
+    enum Status {
+        // has to be fetched from the server
+        StatusUnresolved,
+        StatusResolving,
+        // item is complete, uri not chosen yet
+        StatusLoaded,
+        StatusPlayable,
+        StatusUnplayable
+    };
+
+    struct Entry {
+        QString    id;
+        // position in the container, for rows the model had not loaded
+        int        position;
+        BrowseItem item;
+        Status     status;
+        QString    uri;
+        QString    metaData;
+    };
+
+    void resolve(int entry);
+    void fetch(int entry);
+    void resolveAhead();
+    int nextPlayable(int entry, bool *pending);
+    bool play(int entry);
+    void handOverNext();
+    void cancelCalls();
+    void continueWaiting();
+
+    UPnPRenderer         *m_renderer;
+    QList<Entry>          m_entries;
+    ProtocolInfoMatcher   m_matcher;
+    // copies of the model's calls to fetch entries with
+    ServiceProxyCall     *m_browseCall;
+    ServiceProxyCall     *m_metaDataCall;
+    BrowseScheduler      *m_scheduler;
+    BrowseCrawler        *m_crawler;
+    // running calls and the entries they resolve
+    QHash<ServiceProxyCall *, QList<int> > m_calls;
+    int                   m_current;
+    // entry given to the renderer with SetNextAVTransportURI, -1 if none
+    int                   m_handedOver;
+    bool                  m_gapless;
+    bool                  m_advancing;
+    // set while a track started by the queue has not started playing
+    bool                  m_switching;
+    // set while next() waits for the next entry to be fetched
+    bool                  m_waiting;
+};
+
+#endif // PLAYBACKQUEUE_H
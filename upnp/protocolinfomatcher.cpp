@@ -0,0 +1,123 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QStringList>
+
+#include "protocolinfomatcher.h"
+
+const QLatin1String WILDCARD = QLatin1String("*");
+
+ProtocolInfoMatcher::ProtocolInfoMatcher(const QString &sinkProtocolInfo)
+    : m_sinks()
+    , m_results()
+{
+    Q_FOREACH(const QString &sink, sinkProtocolInfo.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+        Entry entry;
+
+        if (parse(sink, &entry)) {
+            m_sinks[indexKey(entry.protocol, entry.mimeType)] << entry;
+        }
+    }
+}
+
+/*!
+ * \brief Check whether the renderer can play a resource.
+ * \param protocolInfo protocolInfo of the resource
+ */
+bool ProtocolInfoMatcher::isCompatible(const QString &protocolInfo) const
+{
+    auto it = m_results.constFind(protocolInfo);
+    if (it != m_results.constEnd()) {
+        return it.value();
+    }
+
+    Entry source;
+    bool result = false;
+
+    if (parse(protocolInfo, &source)) {
+        const QString keys[] = {
+            indexKey(source.protocol, source.mimeType),
+            indexKey(source.protocol, WILDCARD),
+            indexKey(WILDCARD, source.mimeType),
+            indexKey(WILDCARD, WILDCARD)
+        };
+
+        for (unsigned int i = 0; i < sizeof(keys) / sizeof(keys[0]) && not result; i++) {
+            result = matches(source, m_sinks.value(keys[i]));
+        }
+    }
+
+    m_results.insert(protocolInfo, result);
+
+    return result;
+}
+
+/*!
+ * \brief Split a protocolInfo into its fields.
+ *
+ * Protocol and MIME type are lower-cased, only the DLNA profile is taken
+ * from the additional info.
+ */
+bool ProtocolInfoMatcher::parse(const QString &protocolInfo, Entry *entry)
+{
+    QStringList fields = protocolInfo.trimmed().split(QLatin1Char(':'));
+
+    if (fields.count() < 4) {
+        return false;
+    }
+
+    entry->protocol = fields.at(0).toLower();
+    entry->network = fields.at(1);
+    entry->mimeType = fields.at(2).toLower();
+    entry->profile.clear();
+
+    // The additional info may contain ':' itself
+    const QString additionalInfo = QStringList(fields.mid(3)).join(QLatin1String(":"));
+    Q_FOREACH(const QString &param, additionalInfo.split(QLatin1Char(';'))) {
+        if (param.startsWith(QLatin1String("DLNA.ORG_PN="))) {
+            entry->profile = param.mid(12);
+
+            break;
+        }
+    }
+
+    return true;
+}
+
+QString ProtocolInfoMatcher::indexKey(const QString &protocol, const QString &mimeType)
+{
+    return protocol + QLatin1Char(' ') + mimeType;
+}
+
+bool ProtocolInfoMatcher::matches(const Entry &source, const QList<Entry> &sinks) const
+{
+    Q_FOREACH(const Entry &sink, sinks) {
+        if (source.protocol == QLatin1String("internal") &&
+            sink.network != source.network) {
+            continue;
+        }
+
+        if (not sink.profile.isEmpty() && sink.profile != WILDCARD &&
+            not source.profile.isEmpty() && sink.profile != source.profile) {
+            continue;
+        }
+
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,59 @@
+/*
+This file is part of Helium.
+
+Helium is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Helium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Helium.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROTOCOLINFOMATCHER_H
+#define PROTOCOLINFOMATCHER_H
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+/*!
+ * \brief Checks resources against a renderer's Sink protocolInfo.
+ *
+ * The Sink list is parsed once and indexed by protocol and MIME type, so
+ * checking a resource only looks at the few entries that can match. Follows
+ * the rules of gupnp_protocol_info_is_compatible(): protocol, network (for
+ * the "internal" protocol), MIME type and DLNA profile have to match, "*"
+ * on the sink side matches anything. DLNA flags are not considered.
+ */
+class ProtocolInfoMatcher
+{
+public:
+    explicit ProtocolInfoMatcher(const QString &sinkProtocolInfo = QString());
+
+    bool isCompatible(const QString &protocolInfo) const;
+
+private:
+    struct Entry {
+        QString protocol;
+        QString network;
+        QString mimeType;
+        QString profile;
+    };
+
+    static bool parse(const QString &protocolInfo, Entry *entry);
+    static QString indexKey(const QString &protocol, const QString &mimeType);
+    bool matches(const Entry &source, const QList<Entry> &sinks) const;
+
+    QHash<QString, QList<Entry> > m_sinks;
+
+    // Resources of a container mostly share the same few protocolInfos
+    mutable QHash<QString, bool> m_results;
+};
+
+#endif // PROTOCOLINFOMATCHER_H
@@ -19,30 +19,86 @@ along with Helium.  If not, see <http://www.gnu.org/licenses/>.
 #include <QDebug>
 #include <QtDeclarative>
 
+#include "browsecache.h"
+#include "browsecrawler.h"
 #include "browsemodel.h"
 #include "browsemodelstack.h"
+#include "browseslicesizer.h"
 #include "upnpmediaserver.h"
 #include "serviceproxy.h"
 #include "serviceproxycall.h"
-
-const int BROWSE_SLICE = 100;
-const QString BROWSE_DEFAULT_FILTER = QLatin1String("res@size,res@duration,res@resolution,dc:title,upnp:class,@id,upnp:albumArtURI,upnp:artist,upnp:album");
+#include "glib-utils.h"
 
 const char UPnPMediaServer::DEVICE_TYPE[] = "urn:schemas-upnp-org:device:MediaServer:";
 const char UPnPMediaServer::CONTENT_DIRECTORY_SERVICE[] = "urn:schemas-upnp-org:service:ContentDirectory";
 const QLatin1String MUSIC_ALBUM_CLASS = QLatin1String("object.container.album.musicAlbum");
 
+// Properties a search-entry text is looked up in, if the server supports them
+const char *SEARCH_PROPERTIES[] = { "dc:title", "upnp:artist", "upnp:album", 0 };
+
+/*!
+ * \brief Out-arguments of Browse and Search.
+ *
+ * Calls asking for the same objects share one action, so models and the
+ * crawler browsing the same container do not browse it twice.
+ */
+static QStringList browseResults()
+{
+    return QStringList() << QLatin1String("Result")
+                         << QLatin1String("NumberReturned")
+                         << QLatin1String("TotalMatches")
+                         << QLatin1String("UpdateID");
+}
+
+// Servers known to cope with big Browse slices
+const char *LARGE_SLICE_SERVERS[] = { "Rygel", "MiniDLNA", "ReadyDLNA", 0 };
+
 UPnPMediaServer::UPnPMediaServer()
     : UPnPDevice()
     , m_contentDirectory()
     , m_connectionManager()
     , m_protocolInfo()
     , m_sortCriteria()
+    , m_localSort()
+    , m_searchCaps()
+    , m_systemUpdateId()
+    , m_containerUpdateIds()
+    , m_browseRoles()
+    , m_browseFilter(BrowseModel::completeFilter())
 {
 }
 
 UPnPMediaServer::~UPnPMediaServer()
 {
+    unsubscribe();
+}
+
+void UPnPMediaServer::unsubscribe()
+{
+    if (m_contentDirectory.isNull() || m_contentDirectory->isNull()) {
+        return;
+    }
+
+    m_contentDirectory->setSubscribed(false);
+    m_contentDirectory->removeNotify(QLatin1String("SystemUpdateID"));
+    m_contentDirectory->removeNotify(QLatin1String("ContainerUpdateIDs"));
+    m_contentDirectory->disconnect(this, SLOT(onContentDirectoryNotify(QString,QVariant)));
+}
+
+/*!
+ * \brief Track the update ids the browse cache is validated against.
+ */
+void UPnPMediaServer::onContentDirectoryNotify(const QString &variable, const QVariant &value)
+{
+    if (variable == QLatin1String("SystemUpdateID")) {
+        m_systemUpdateId = value.toString();
+    } else if (variable == QLatin1String("ContainerUpdateIDs")) {
+        // Comma-separated list of container id, update id pairs
+        QStringList ids = value.toString().split(QLatin1Char(','));
+        for (int i = 0; i + 1 < ids.count(); i += 2) {
+            m_containerUpdateIds[ids.at(i)] = ids.at(i + 1);
+        }
+    }
 }
 
 void UPnPMediaServer::onGetProtocolInfo()
@@ -90,6 +146,176 @@ void UPnPMediaServer::onGetSortCapabilities()
     }
 }
 
+void UPnPMediaServer::onGetSearchCapabilities()
+{
+    ServiceProxyCall *call = qobject_cast<ServiceProxyCall *>(sender());
+    if (call == 0) {
+        return;
+    }
+
+    unqueueCall(call, QStringList() << QLatin1String("SearchCaps"));
+    if (call->hasError()) {
+        qDebug() << "Failed to retrieve search caps" << call->errorMessage();
+    } else {
+        m_searchCaps = call->get(QLatin1String("SearchCaps")).toString().split(QLatin1Char(','), QString::SkipEmptyParts);
+        Q_EMIT canSearchChanged();
+    }
+
+    if (not callsPending()) {
+        Q_EMIT ready();
+    }
+}
+
+/*!
+ * \brief Turn a search-entry text into a SearchCriteria.
+ * \return the criteria or an empty string if the server cannot search for
+ *         any of SEARCH_PROPERTIES
+ */
+QString UPnPMediaServer::searchCriteria(const QString &text) const
+{
+    QString escaped = text;
+    QStringList criteria;
+
+    escaped.replace(QLatin1String("\\"), QLatin1String("\\\\"));
+    escaped.replace(QLatin1String("\""), QLatin1String("\\\""));
+
+    for (int i = 0; SEARCH_PROPERTIES[i] != 0; i++) {
+        const QString property = QLatin1String(SEARCH_PROPERTIES[i]);
+
+        if (m_searchCaps.contains(property) || m_searchCaps.contains(QLatin1String("*"))) {
+            criteria << QString::fromLatin1("%1 contains \"%2\"").arg(property, escaped);
+        }
+    }
+
+    return criteria.join(QLatin1String(" or "));
+}
+
+bool UPnPMediaServer::canSearch() const
+{
+    return not searchCriteria(QLatin1String("x")).isEmpty();
+}
+
+/*!
+ * \brief Set the roles the browse view binds.
+ *
+ * Browse and Search calls then only ask for the properties these roles
+ * need. Other roles are fetched per row with BrowseMetadata when read.
+ *
+ * \param roles role names, all properties are requested if empty
+ */
+void UPnPMediaServer::setBrowseRoles(const QStringList &roles)
+{
+    if (roles == m_browseRoles) {
+        return;
+    }
+
+    m_browseRoles = roles;
+    m_browseFilter = roles.isEmpty() ? BrowseModel::completeFilter()
+                                     : BrowseModel::filterForRoles(roles);
+    qDebug() << "Using Browse filter" << m_browseFilter;
+    Q_EMIT browseRolesChanged();
+}
+
+/*!
+ * \brief BrowseMetadata call asking for all properties of an object.
+ */
+ServiceProxyCall *UPnPMediaServer::metaDataCall() const
+{
+    auto call = m_contentDirectory->call(QLatin1String("Browse"),
+                                         QLatin1String("ObjectID"), QLatin1String(""),
+                                         QLatin1String("BrowseFlag"), QLatin1String("BrowseMetadata"),
+                                         QLatin1String("Filter"), BrowseModel::completeFilter(),
+                                         QLatin1String("StartingIndex"), 0,
+                                         QLatin1String("RequestedCount"), 0,
+                                         QLatin1String("SortCriteria"), QLatin1String(""));
+    call->setShared(browseResults());
+
+    return call;
+}
+
+/*!
+ * \brief Search the current container on the server.
+ *
+ * Pushes a model with the results on the BrowseModelStack, replacing the
+ * results of a previous search. An empty text only removes them. Results
+ * are inserted page by page as they arrive, like Browse results.
+ *
+ * \param text text to look for in title, artist and album
+ * \param protocolInfo Sink protocolInfo of the current renderer
+ */
+void UPnPMediaServer::search(const QString &text, const QString &protocolInfo)
+{
+    BrowseModelStack &stack = BrowseModelStack::getDefault();
+
+    if (stack.top() != 0 && not stack.top()->searchText().isEmpty()) {
+        stack.pop();
+    }
+
+    if (text.isEmpty() || not canSearch()) {
+        return;
+    }
+
+    QString containerId = QLatin1String("0");
+    if (stack.top() != 0 && not stack.top()->objectId().isEmpty()) {
+        containerId = stack.top()->objectId();
+    }
+
+    auto call = m_contentDirectory->call(QLatin1String("Search"),
+                                         QLatin1String("ContainerID"), containerId,
+                                         QLatin1String("SearchCriteria"), searchCriteria(text),
+                                         QLatin1String("Filter"), m_browseFilter,
+                                         QLatin1String("StartingIndex"), 0,
+                                         QLatin1String("RequestedCount"), BrowseSliceSizer::forServer(udn())->sliceSize(),
+                                         QLatin1String("SortCriteria"), m_sortCriteria[SORT_DEFAULT]);
+
+    call->setShared(browseResults());
+
+    auto model = new BrowseModel(call, protocolInfo, udn());
+    model->setSearchText(text);
+    model->setMetaDataCall(metaDataCall());
+    model->setLocalSort(m_localSort.value(SORT_DEFAULT, BrowseModel::SortNone));
+    connect(model, SIGNAL(error(int, QString)), SIGNAL(error(int,QString)));
+    stack.push(model);
+
+    if (not callsPending()) {
+        model->refresh();
+    } else {
+        connect(this, SIGNAL(ready()), model, SLOT(refresh()));
+    }
+}
+
+/*!
+ * \brief Start crawling the container tree below id.
+ *
+ * The caller connects to the crawler's signals and deletes it when done.
+ * Used by the playback queue to play a container with all containers
+ * below it.
+ *
+ * \param id ObjectID of the container to start at
+ * \return the crawler, 0 if no server is wrapped
+ */
+BrowseCrawler *UPnPMediaServer::crawl(const QString &id, QObject *parent)
+{
+    if (m_contentDirectory.isNull() || m_contentDirectory->isNull()) {
+        return 0;
+    }
+
+    auto call = m_contentDirectory->call(QLatin1String("Browse"),
+                                         QLatin1String("ObjectID"), id,
+                                         QLatin1String("BrowseFlag"), QLatin1String("BrowseDirectChildren"),
+                                         QLatin1String("Filter"), BrowseModel::completeFilter(),
+                                         QLatin1String("StartingIndex"), 0,
+                                         QLatin1String("RequestedCount"), 0,
+                                         QLatin1String("SortCriteria"), m_sortCriteria[SORT_DEFAULT]);
+
+    call->setShared(browseResults());
+
+    auto crawler = new BrowseCrawler(call, udn(), parent);
+    crawler->start(id);
+
+    return crawler;
+}
+
 void UPnPMediaServer::setupSortCriterias(const QString &caps)
 {
     QStringList sortCaps = caps.split(QLatin1Char(','));
@@ -114,14 +340,37 @@ void UPnPMediaServer::setupSortCriterias(const QString &caps)
         sortCriteria << sortCaps.at(titleIndex);
     }
     m_sortCriteria[SORT_MUSIC_ALUBM] = sortCriteria.replaceInStrings(QRegExp(QLatin1String("^")), QLatin1String("+")).join(QLatin1String(","));
+
+    // Whatever the server can not sort by is sorted on the device
+    m_localSort[SORT_DEFAULT] = classIndex < 0 || titleIndex < 0 ? BrowseModel::SortByClassAndTitle
+                                                                 : BrowseModel::SortNone;
+    m_localSort[SORT_MUSIC_ALUBM] = trackNrIndex < 0 || titleIndex < 0 ? BrowseModel::SortByTrackAndTitle
+                                                                       : BrowseModel::SortNone;
+    qDebug() << "Sorting locally:" << m_localSort[SORT_DEFAULT] << m_localSort[SORT_MUSIC_ALUBM];
 }
 
 void UPnPMediaServer::wrapDevice(const QString &udn)
 {
+    unsubscribe();
     UPnPDevice::wrapDevice(udn);
     m_contentDirectory.reset(getService(UPnPMediaServer::CONTENT_DIRECTORY_SERVICE));
+    m_systemUpdateId.clear();
+    m_containerUpdateIds.clear();
+    m_searchCaps.clear();
+    Q_EMIT canSearchChanged();
     m_connectionManager.reset(getService(UPnPDevice::CONNECTION_MANAGER_SERVICE));
 
+    if (not m_proxy.isEmpty()) {
+        ScopedGPointer modelName(gupnp_device_info_get_model_name(GUPNP_DEVICE_INFO(m_proxy)));
+        for (int i = 0; LARGE_SLICE_SERVERS[i] != 0 && not modelName.isNull(); i++) {
+            if (g_strstr_len(modelName.data(), -1, LARGE_SLICE_SERVERS[i]) != 0) {
+                BrowseSliceSizer::forServer(udn)->setLimits(10, 2000);
+
+                break;
+            }
+        }
+    }
+
     // Get information on the device we need later on
     if (not m_connectionManager.isNull() && not m_connectionManager->isNull()) {
         queueCall(m_connectionManager->call(QLatin1String("GetProtocolInfo")),
@@ -129,8 +378,16 @@ void UPnPMediaServer::wrapDevice(const QString &udn)
     }
 
     if (m_contentDirectory && not m_contentDirectory->isNull()) {
+        m_contentDirectory->addNotify(QLatin1String("SystemUpdateID"));
+        m_contentDirectory->addNotify(QLatin1String("ContainerUpdateIDs"));
+        m_contentDirectory->setSubscribed(true);
+        connect(m_contentDirectory.data(), SIGNAL(notify(QString,QVariant)),
+                SLOT(onContentDirectoryNotify(QString,QVariant)));
+
         queueCall(m_contentDirectory->call(QLatin1String("GetSortCapabilities")),
                   SLOT(onGetSortCapabilities()));
+        queueCall(m_contentDirectory->call(QLatin1String("GetSearchCapabilities")),
+                  SLOT(onGetSearchCapabilities()));
     }
 }
 
@@ -141,15 +398,45 @@ void UPnPMediaServer::browse(const QString &id, const QString &upnpClass, const
         sortOrder = SORT_MUSIC_ALUBM;
     }
 
+    // Tracks can only be sorted locally if their numbers are there
+    QString filter = m_browseFilter;
+    const QLatin1String trackNumber("upnp:originalTrackNumber");
+    if (m_localSort.value(sortOrder) == BrowseModel::SortByTrackAndTitle &&
+        not filter.split(QLatin1Char(',')).contains(trackNumber)) {
+        filter += QLatin1Char(',');
+        filter += trackNumber;
+    }
+
+    // Navigating back into a container we just left
+    BrowseModel *cached = BrowseModelStack::getDefault().takeCached(udn(), id, filter);
+    if (cached != 0) {
+        if (cached->isCurrent(m_systemUpdateId, m_containerUpdateIds.value(id))) {
+            cached->setProtocolInfo(protocolInfo);
+            connect(cached, SIGNAL(error(int, QString)), SIGNAL(error(int,QString)), Qt::UniqueConnection);
+            BrowseModelStack::getDefault().push(cached);
+
+            return;
+        }
+
+        cached->deleteLater();
+    }
+
     auto call = m_contentDirectory->call(QLatin1String("Browse"),
                                          QLatin1String("ObjectID"), id,
                                          QLatin1String("BrowseFlag"), QLatin1String("BrowseDirectChildren"),
-                                         QLatin1String("Filter"), BROWSE_DEFAULT_FILTER,
+                                         QLatin1String("Filter"), filter,
                                          QLatin1String("StartingIndex"), 0,
-                                         QLatin1String("RequestedCount"), BROWSE_SLICE,
+                                         QLatin1String("RequestedCount"), BrowseSliceSizer::forServer(udn())->sliceSize(),
                                          QLatin1String("SortCriteria"), m_sortCriteria[sortOrder]);
 
-    auto model = new BrowseModel(call, protocolInfo);
+    call->setShared(browseResults());
+
+    auto model = new BrowseModel(call, protocolInfo, udn());
+    model->setCache(BrowseCache::key(udn(), id, m_sortCriteria[sortOrder], filter),
+                    m_systemUpdateId,
+                    m_containerUpdateIds.value(id));
+    model->setMetaDataCall(metaDataCall());
+    model->setLocalSort(m_localSort.value(sortOrder, BrowseModel::SortNone));
     connect(model, SIGNAL(error(int, QString)), SIGNAL(error(int,QString)));
     BrowseModelStack::getDefault().push(model);
 
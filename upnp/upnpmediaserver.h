@@ -21,13 +21,17 @@ along with Helium.  If not, see <http://www.gnu.org/licenses/>.
 #include <QObject>
 #include <QtCore/QScopedPointer>
 
+#include "browsemodel.h"
 #include "upnpdevice.h"
 
+class BrowseCrawler;
 class ServiceProxy;
 class UPnPMediaServer : public UPnPDevice
 {
     Q_OBJECT
     Q_ENUMS(SortOrder)
+    Q_PROPERTY(bool canSearch READ canSearch NOTIFY canSearchChanged)
+    Q_PROPERTY(QStringList browseRoles READ browseRoles WRITE setBrowseRoles NOTIFY browseRolesChanged)
 public:
     enum SortOrder {
         SORT_DEFAULT,
@@ -44,18 +48,42 @@ public:
     Q_INVOKABLE void browse(const QString &id = QLatin1String("0"),
                             const QString &upnpClass = QLatin1String("object.container"),
                             const QString &protocolInfo = QLatin1String(""));
+    Q_INVOKABLE void search(const QString &text,
+                            const QString &protocolInfo = QLatin1String(""));
+
+    BrowseCrawler *crawl(const QString &id, QObject *parent = 0);
+
+    bool canSearch() const;
+    QStringList browseRoles() const { return m_browseRoles; }
+    void setBrowseRoles(const QStringList &roles);
+
+Q_SIGNALS:
+    void canSearchChanged();
+    void browseRolesChanged();
 
 private Q_SLOTS:
     void onGetSortCapabilities();
+    void onGetSearchCapabilities();
     void onGetProtocolInfo();
+    void onContentDirectoryNotify(const QString &variable, const QVariant &value);
 private:
     QScopedPointer<ServiceProxy> m_contentDirectory;
     QScopedPointer<ServiceProxy> m_connectionManager;
     QString                   m_protocolInfo;
     QHash<SortOrder, QString> m_sortCriteria;
+    // sort orders the server can not sort by
+    QHash<SortOrder, BrowseModel::LocalSort> m_localSort;
+    QStringList               m_searchCaps;
+    QString                   m_systemUpdateId;
+    QHash<QString, QString>   m_containerUpdateIds;
+    QStringList               m_browseRoles;
+    QString                   m_browseFilter;
 
     bool isReady();
     void setupSortCriterias(const QString &caps);
+    QString searchCriteria(const QString &text) const;
+    ServiceProxyCall *metaDataCall() const;
+    void unsubscribe();
 };
 
 #endif // UPNPMEDIASERVER_H
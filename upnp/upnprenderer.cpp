@@ -20,9 +20,12 @@ along with Helium.  If not, see <http://www.gnu.org/licenses/>.
 #include <QDebug>
 #include <QStringList>
 
+#include "didllitestreamparser.h"
+#include "browsemodel.h"
 #include "glib-utils.h"
+#include "playbackqueue.h"
+#include "upnpmediaserver.h"
 #include "upnprenderer.h"
-#include "didlliteparser.h"
 
 const QString START_POSITION = QLatin1String("0:00:00");
 
@@ -46,6 +49,31 @@ static quint64 parseDurationString(const QString& duration)
     return seconds;
 }
 
+// Milliseconds of a position, keeping the fraction of a second if given
+static qint64 parsePositionString(const QString &position)
+{
+    qint64 milliseconds = parseDurationString(position) * 1000;
+    auto index = position.indexOf(QLatin1Char('.'));
+
+    if (index > 0) {
+        milliseconds += qRound(position.mid(index).toDouble() * 1000);
+    }
+
+    return milliseconds;
+}
+
+static QString formatPosition(quint64 position)
+{
+    int hours = position / 3600;
+    position %= 3600;
+    int minutes = position / 60;
+    int seconds = position % 60;
+
+    return QString::fromLatin1("%1:%2:%3").arg(hours)
+                                          .arg(minutes, 2, 10, QLatin1Char('0'))
+                                          .arg(seconds, 2, 10, QLatin1Char('0'));
+}
+
 const char UPnPRenderer::DEVICE_TYPE[] = "urn:schemas-upnp-org:device:MediaRenderer:";
 const char UPnPRenderer::AV_TRANSPORT_SERVICE[] = "urn:schemas-upnp-org:service:AVTransport";
 const char UPnPRenderer::RENDERING_CONTROL_SERVICE[] = "urn:schemas-upnp-org:service:RenderingControl";
@@ -54,15 +82,10 @@ void UPnPRenderer::setState(const QString &state)
 {
     qDebug () << "New state" << state;
     m_state = state;
-    if (state == QLatin1String("PLAYING")) {
-        m_progressTimer.start(1000);
-    } else {
-        m_progressTimer.stop();
-    }
-
     if (state == QLatin1String("STOPPED")) {
-        setProgress(0.0);
-        setPosition(START_POSITION);
+        m_clock.reset();
+    } else {
+        m_clock.setRunning(state == QLatin1String("PLAYING"));
     }
 
     Q_EMIT stateChanged();
@@ -76,6 +99,7 @@ void UPnPRenderer::setDuration(const QString& trackDuration)
 
     m_duration = trackDuration;
     m_durationInSeconds = parseDurationString(m_duration);
+    m_clock.setDuration(m_durationInSeconds * 1000);
 
     Q_EMIT durationChanged();
 }
@@ -137,6 +161,17 @@ void UPnPRenderer::setPosition(const QString &position)
     Q_EMIT positionChanged();
 }
 
+void UPnPRenderer::setTrackUri(const QString &uri)
+{
+    if (uri == m_trackUri) {
+        return;
+    }
+
+    m_trackUri = uri;
+
+    Q_EMIT trackUriChanged();
+}
+
 void UPnPRenderer::setCanSeek(bool canSeek)
 {
     if (canSeek == m_canSeek) {
@@ -181,6 +216,17 @@ void UPnPRenderer::setVolume(unsigned int volume)
     Q_EMIT volumeChanged();
 }
 
+void UPnPRenderer::setReadyTime(int readyTime)
+{
+    if (m_readyTime == readyTime) {
+        return;
+    }
+
+    m_readyTime = readyTime;
+
+    Q_EMIT readyTimeChanged();
+}
+
 void UPnPRenderer::setMaxVolume(unsigned int maxVolume)
 {
     if (m_maxVolume == maxVolume) {
@@ -216,17 +262,27 @@ void UPnPRenderer::setCanVolume(bool canVolume)
 
 UPnPRenderer::UPnPRenderer()
     : UPnPDevice()
-    , m_lastChangeParser(wrap(gupnp_last_change_parser_new()))
+    , m_lastChangeParser()
+    , m_metaData()
     , m_avTransport()
     , m_connectionManager()
     , m_renderingControl(0)
+    , m_pendingSteps(0)
+    , m_protocolInfoCall(0)
+    , m_bringUpTimer()
+    , m_readyTime(-1)
     , m_state(QLatin1String("NO_MEDIA_PRESENT"))
     , m_protocolInfo(QLatin1String("*:*:*:*"))
     , m_duration(START_POSITION)
-    , m_progressTimer()
+    , m_clock()
+    , m_positionCall(0)
+    , m_durationInSeconds(0)
     , m_canPause(false)
     , m_currentTitle()
     , m_position(START_POSITION)
+    , m_trackUri()
+    , m_queue(new PlaybackQueue(this))
+    , m_queuedPlay(0)
     , m_canSeek(false)
     , m_seekMode(QLatin1String(""))
     , m_canVolume(false)
@@ -235,111 +291,126 @@ UPnPRenderer::UPnPRenderer()
     , m_canMute(false)
     , m_mute(false)
 {
-    connect(&m_progressTimer, SIGNAL(timeout()), SLOT(onProgressTimeout()));
+    for (int i = 0; i < COMMAND_COUNT; i++) {
+        m_commands[i] = 0;
+    }
+
+    connect(&m_clock, SIGNAL(tick()), SLOT(onClockTick()));
+    connect(&m_clock, SIGNAL(resyncRequested()), SLOT(onResyncRequested()));
 }
 
 void UPnPRenderer::onLastChange(const QString &name, const QVariant &value)
 {
     Q_UNUSED(name);
 
-    qDebug() << value.toString();
-    GError *error = 0;
-
-    if (sender() == m_renderingControl.data()) {
-        char *mute_str = 0, *volume_str = 0;
-        gboolean mute;
-        unsigned int volume;
-
-        if (gupnp_last_change_parser_parse_last_change(m_lastChangeParser,
-                                                       0,
-                                                       value.toString().toUtf8().constData(),
-                                                       &error,
-                                                       "Mute", G_TYPE_STRING, &mute_str,
-                                                       "Mute", G_TYPE_BOOLEAN, &mute,
-                                                       "Volume", G_TYPE_STRING, &volume_str,
-                                                       "Volume", G_TYPE_UINT, &volume,
-                                                       NULL)) {
-            if (mute_str != 0) {
-                setMute(mute == TRUE);
-                g_free(mute_str);
-            }
+    const QByteArray lastChange = value.toString().toUtf8();
 
-            if (volume_str != 0) {
-                setVolume(volume);
-                g_free(volume_str);
-            }
-        } else {
-            qDebug() << "Failed to parse last change" << error->message;
-            g_error_free(error);
+    if (not m_lastChangeParser.parse(lastChange.constData(), lastChange.size())) {
+        qDebug() << "Failed to parse last change" << m_lastChangeParser.errorMessage();
+
+        return;
+    }
+
+    Q_FOREACH(const LastChangeSet &change, m_lastChangeParser.changes()) {
+        if (change.instanceId == 0) {
+            applyLastChange(change);
         }
-    } else if (sender() == m_avTransport.data()){
-        char *state_name = 0;
-        char *track_duration = 0;
-        char *track_uri = 0;
-        char *track_meta_data = 0;
-        char *av_transport_meta_data = 0;
-        const char *meta_data = 0;
-
-        if (gupnp_last_change_parser_parse_last_change(m_lastChangeParser,
-                                                       0,
-                                                       value.toString().toUtf8().constData(),
-                                                       &error,
-                                                       "TransportState", G_TYPE_STRING, &state_name,
-                                                       "CurrentTrackDuration", G_TYPE_STRING, &track_duration,
-                                                       "CurrentTrackURI", G_TYPE_STRING, &track_uri,
-                                                       "AVTransportURIMetadata", G_TYPE_STRING, &av_transport_meta_data,
-                                                       "CurrentTrackMetadata", G_TYPE_STRING, &track_meta_data,
-                                                       NULL)) {
-            if (state_name != 0) {
-                setState(QString::fromUtf8(state_name));
-
-                g_free(state_name);
-            }
+    }
+}
 
-            if (track_duration != 0) {
-                setDuration(QString::fromUtf8(track_duration));
+/*!
+ * \brief Take over the variables of instance 0 a LastChange event reported.
+ *
+ * The title is only extracted again if the metadata changed; renderers
+ * repeat it in every event while changing tracks.
+ */
+void UPnPRenderer::applyLastChange(const LastChangeSet &change)
+{
+    // Values for commands still busy are outdated by the time they arrive
+    if (change.has(LastChangeSet::FieldMute)) {
+        if (commandBusy(CommandMute)) {
+            m_heldChanges[CommandMute] = change.mute;
+        } else {
+            setMute(change.mute);
+        }
+    }
 
-                g_free(track_duration);
-            }
+    if (change.has(LastChangeSet::FieldVolume)) {
+        if (commandBusy(CommandVolume)) {
+            m_heldChanges[CommandVolume] = change.volume;
+        } else {
+            setVolume(change.volume);
+        }
+    }
 
-            if (track_meta_data != 0) {
-                meta_data = track_meta_data;
-            } else if (av_transport_meta_data != 0) {
-                meta_data = av_transport_meta_data;
-            }
+    if (change.has(LastChangeSet::FieldTransportState) &&
+        change.transportState != LastChangeSet::StateUnknown) {
+        setState(QLatin1String(LastChangeSet::stateName(change.transportState)));
+    }
 
-            if (meta_data != 0) {
-                auto objects = DIDLLiteParser().parse(meta_data);
-                if (not objects.empty()) {
-                    setTitle(QString::fromUtf8(gupnp_didl_lite_object_get_title(objects.first())));
-                }
-            }
+    if (change.has(LastChangeSet::FieldTrackDuration)) {
+        setDuration(formatPosition(qMax(change.trackDuration, qint64(0)) / 1000));
+    }
 
-            if (track_meta_data != 0) {
-                g_free(track_meta_data);
-            }
+    const QByteArray *metaData = 0;
+    if (change.has(LastChangeSet::FieldTrackMetaData)) {
+        metaData = &change.trackMetaData;
+    } else if (change.has(LastChangeSet::FieldTransportMetaData)) {
+        metaData = &change.transportMetaData;
+    }
 
-            if (av_transport_meta_data != 0) {
-                g_free(av_transport_meta_data);
-            }
+    if (metaData != 0 && *metaData != m_metaData) {
+        DIDLLiteStreamParser parser;
 
-            if (m_currentTitle.isEmpty() && track_uri != 0) {
-                setTitle(QString::fromUtf8(track_uri));
+        m_metaData = *metaData;
+        if (parser.parse(m_metaData.constData(), m_metaData.size()) &&
+            not parser.records().isEmpty() &&
+            parser.records().first().title != 0) {
+            setTitle(QString::fromUtf8(parser.records().first().title));
+        }
+    }
 
-                g_free(track_uri);
-            }
-        } else {
-            qDebug() << "Failed to parse last change" << error->message;
-            g_error_free(error);
+    if (change.has(LastChangeSet::FieldTrackUri)) {
+        setTrackUri(QString::fromUtf8(change.trackUri.constData(), change.trackUri.size()));
+        if (m_currentTitle.isEmpty()) {
+            setTitle(m_trackUri);
         }
     }
+
+    // The position may have jumped with any change of the transport
+    if (change.has(LastChangeSet::FieldTransportState) ||
+        change.has(LastChangeSet::FieldTrackDuration) ||
+        change.has(LastChangeSet::FieldTrackUri)) {
+        m_clock.resync();
+    }
 }
 
-void UPnPRenderer::onProgressTimeout()
+/*!
+ * \brief Show the position the PlaybackClock estimates.
+ */
+void UPnPRenderer::onClockTick()
 {
-    queueCall(m_avTransport->call(QLatin1String("GetPositionInfo"),
-                                  QLatin1String("InstanceID"), 0),
-              SLOT(onGetPositionInfoReady()));
+    const qint64 position = m_clock.position();
+
+    setPosition(formatPosition(position / 1000));
+    if (m_durationInSeconds > 0) {
+        setProgress((double) position / (double) (m_durationInSeconds * 1000));
+    } else {
+        setProgress(0.0);
+    }
+}
+
+void UPnPRenderer::onResyncRequested()
+{
+    // The position would still be the one before the seek; onCommandReady()
+    // resyncs once the last seek is done
+    if (m_avTransport.isNull() || m_positionCall != 0 || commandBusy(CommandSeek)) {
+        return;
+    }
+
+    m_positionCall = m_avTransport->call(QLatin1String("GetPositionInfo"),
+                                         QLatin1String("InstanceID"), 0);
+    queueCall(m_positionCall, SLOT(onGetPositionInfoReady()));
 }
 
 void UPnPRenderer::unsubscribe()
@@ -380,11 +451,24 @@ void UPnPRenderer::wrapDevice(const QString &udn)
     setDuration(START_POSITION);
     setCanPause(false);
     setTitle(QString());
-    setPosition(START_POSITION);
-    setProgress(0.0f);
+    setTrackUri(QString());
+    m_queue->clear();
+    m_queuedPlay = 0;
+    for (int i = 0; i < COMMAND_COUNT; i++) {
+        m_commands[i] = 0;
+        m_queuedCommands[i] = QVariant();
+        m_heldChanges[i] = QVariant();
+    }
+    m_queue->setGapless(false);
+    m_metaData.clear();
+    m_clock.reset();
+    m_positionCall = 0;
     m_avTransport.reset(0);
     m_connectionManager.reset(0);
     m_renderingControl.reset(0);
+    m_pendingSteps = 0;
+    m_protocolInfoCall = 0;
+    setReadyTime(-1);
 
     if (m_proxy.isEmpty()) {
         return;
@@ -395,12 +479,30 @@ void UPnPRenderer::wrapDevice(const QString &udn)
     m_connectionManager.reset(getService(UPnPDevice::CONNECTION_MANAGER_SERVICE));
     m_renderingControl.reset(getService(UPnPRenderer::RENDERING_CONTROL_SERVICE));
 
+    // None of the steps needs the result of another one, so they all run
+    // at the same time; bringUpDone() emits ready() after the last one
+    m_bringUpTimer.start();
+    m_pendingSteps = StepProtocolInfo | StepAVTransport;
+    if (not m_renderingControl.isNull()) {
+        m_pendingSteps |= StepRenderingControl;
+    }
+
     m_avTransport->addNotify(QLatin1String("LastChange"));
     m_avTransport->setSubscribed(true);
     connect(m_avTransport.data(), SIGNAL(notify(QString,QVariant)), SLOT(onLastChange(QString,QVariant)));
+    connect(m_avTransport.data(), SIGNAL(introspectionReady()), SLOT(onAVTransportIntrospectionReady()));
+    m_avTransport->introspect();
 
-    queueCall(m_connectionManager->call(QLatin1String("GetProtocolInfo")),
-              SLOT(onGetProtocolInfo()));
+    if (not m_renderingControl.isNull()) {
+        m_renderingControl->addNotify(QLatin1String("LastChange"));
+        connect(m_renderingControl.data(), SIGNAL(notify(QString, QVariant)), SLOT(onLastChange(QString,QVariant)));
+        m_renderingControl->setSubscribed(true);
+        connect(m_renderingControl.data(), SIGNAL(introspectionReady()), SLOT(onRenderingControlIntrospectionReady()));
+        m_renderingControl->introspect();
+    }
+
+    m_protocolInfoCall = m_connectionManager->call(QLatin1String("GetProtocolInfo"));
+    queueCall(m_protocolInfoCall, SLOT(onGetProtocolInfo()));
 }
 
 
@@ -412,8 +514,14 @@ void UPnPRenderer::onGetPositionInfoReady()
         return;
     }
 
-    call->finalize(QStringList() << QLatin1String("RelTime"));
-    call->deleteLater();
+    unqueueCall(call, QStringList() << QLatin1String("RelTime"));
+
+    // Answer of a renderer that was wrapped before
+    if (call != m_positionCall) {
+        return;
+    }
+
+    m_positionCall = 0;
 
     if (call->hasError()) {
         Q_EMIT error(call->errorCode(), call->errorMessage());
@@ -421,9 +529,11 @@ void UPnPRenderer::onGetPositionInfoReady()
         return;
     }
 
+    // Renderers that can not tell say NOT_IMPLEMENTED; keep extrapolating
     QString relTime = call->get(QLatin1String("RelTime")).toString();
-    setPosition(relTime);
-    setProgress((double) parseDurationString(relTime) / (double) m_durationInSeconds);
+    if (relTime.contains(QLatin1Char(':'))) {
+        m_clock.sync(parsePositionString(relTime));
+    }
 }
 
 void UPnPRenderer::onGetProtocolInfo()
@@ -434,21 +544,21 @@ void UPnPRenderer::onGetProtocolInfo()
         return;
     }
 
-    call->finalize(QStringList() << QLatin1String("Sink"));
-    call->deleteLater();
-
-    if (call->hasError()) {
-        Q_EMIT error(call->errorCode(), call->errorMessage());
+    unqueueCall(call, QStringList() << QLatin1String("Sink"));
 
+    // Answer of a renderer that was wrapped before
+    if (call != m_protocolInfoCall) {
         return;
     }
 
-    if (call->get(QLatin1String("Sink")).isValid()) {
+    m_protocolInfoCall = 0;
+    if (call->hasError()) {
+        Q_EMIT error(call->errorCode(), call->errorMessage());
+    } else if (call->get(QLatin1String("Sink")).isValid()) {
         setProtocolInfo(call->get(QLatin1String("Sink")).toString());
     }
 
-    connect(m_avTransport.data(), SIGNAL(introspectionReady()), SLOT(onAVTransportIntrospectionReady()));
-    m_avTransport->introspect();
+    bringUpDone(StepProtocolInfo);
 }
 
 void UPnPRenderer::onAVTransportIntrospectionReady()
@@ -456,6 +566,7 @@ void UPnPRenderer::onAVTransportIntrospectionReady()
     auto introspection = m_avTransport->introspection();
     // TODO: Handle error
     setCanPause(introspection->hasAction(QLatin1String("Pause")));
+    m_queue->setGapless(introspection->hasAction(QLatin1String("SetNextAVTransportURI")));
     auto seekModeInfo = introspection->variable(QLatin1String("A_ARG_TYPE_SeekMode"));
     Q_FOREACH(QString seekMode, seekModeInfo.allowedValues()) {
         if (seekMode == QLatin1String("ABS_TIME") ||
@@ -467,12 +578,7 @@ void UPnPRenderer::onAVTransportIntrospectionReady()
         }
     }
 
-    if (not m_renderingControl.isNull()) {
-        connect(m_renderingControl.data(), SIGNAL(introspectionReady()), SLOT(onRenderingControlIntrospectionReady()));
-        m_renderingControl->introspect();
-    } else {
-        Q_EMIT ready();
-    }
+    bringUpDone(StepAVTransport);
 }
 
 void UPnPRenderer::onRenderingControlIntrospectionReady()
@@ -489,12 +595,28 @@ void UPnPRenderer::onRenderingControlIntrospectionReady()
         }
     }
 
-    if (canMute() || canVolume()) {
-        m_renderingControl->addNotify(QLatin1String("LastChange"));
-        connect(m_renderingControl.data(), SIGNAL(notify(QString, QVariant)), SLOT(onLastChange(QString,QVariant)));
-        m_renderingControl->setSubscribed(true);
+    bringUpDone(StepRenderingControl);
+}
+
+/*!
+ * \brief Mark a step of wrapDevice() as finished.
+ *
+ * Emits ready() once all steps finished, whichever finished last.
+ */
+void UPnPRenderer::bringUpDone(BringUpStep step)
+{
+    if ((m_pendingSteps & step) == 0) {
+        return;
+    }
+
+    m_pendingSteps &= ~step;
+    if (m_pendingSteps != 0) {
+        return;
     }
 
+    setReadyTime(m_bringUpTimer.elapsed());
+    qDebug() << "Renderer ready after" << m_readyTime << "ms";
+
     Q_EMIT ready();
 }
 
@@ -516,6 +638,13 @@ void UPnPRenderer::onSetAVTransportUri()
             stop(call.take());
         } else {
             Q_EMIT error(call->errorCode(), call->errorMessage());
+
+            // The item of the queue is not going to play; Play goes away
+            // with the call
+            if (call->next() != 0 && call->next() == m_queuedPlay) {
+                m_queuedPlay = 0;
+                m_queue->playFailed();
+            }
         }
 
         return;
@@ -525,13 +654,40 @@ void UPnPRenderer::onSetAVTransportUri()
         // prevent call's destructor from clearing next
         auto next = call->next();
         call->setNext(0);
-        queueCall(next);
+        if (next == m_queuedPlay) {
+            queueCall(next, SLOT(onPlayQueued()));
+        } else {
+            queueCall(next);
+        }
+    }
+}
+
+/*!
+ * \brief Tell the playback queue if the renderer refused to play its item.
+ */
+void UPnPRenderer::onPlayQueued()
+{
+    auto call = qobject_cast<ServiceProxyCall *>(sender());
+
+    if (call == 0) {
+        return;
+    }
+
+    unqueueCall(call);
+    if (call == m_queuedPlay) {
+        m_queuedPlay = 0;
+    }
+
+    if (call->hasError()) {
+        Q_EMIT error(call->errorCode(), call->errorMessage());
+        m_queue->playFailed();
     }
 }
 
 
 void UPnPRenderer::setAVTransportUri(const QString &uri, const QString &metaData)
 {
+    m_queue->clear();
     setAVTransportUri(uri, metaData, 0);
 }
 
@@ -549,7 +705,19 @@ void UPnPRenderer::setAVTransportUri(const QString &uri, const QString &metaData
     queueCall(call, SLOT(onSetAVTransportUri()));
 }
 
+/*!
+ * \brief Play a single item, dropping the items of the playback queue.
+ */
 void UPnPRenderer::setUriAndPlay(const QString& uri, const QString& metaData)
+{
+    m_queue->clear();
+    playQueued(uri, metaData);
+}
+
+/*!
+ * \brief Play an item of the playback queue.
+ */
+void UPnPRenderer::playQueued(const QString &uri, const QString &metaData)
 {
     if (m_avTransport.isNull()) {
         return;
@@ -558,9 +726,79 @@ void UPnPRenderer::setUriAndPlay(const QString& uri, const QString& metaData)
     auto playCall = m_avTransport->call(QLatin1String("Play"),
                                         QLatin1String("InstanceID"), QLatin1String("0"),
                                         QLatin1String("Speed"), QLatin1String("1"));
+    m_queuedPlay = playCall;
     setAVTransportUri(uri, metaData, playCall);
 }
 
+/*!
+ * \brief Tell the renderer which uri to play after the current one.
+ *
+ * Used by the playback queue if the renderer has SetNextAVTransportURI.
+ */
+void UPnPRenderer::setNextAVTransportUri(const QString &uri, const QString &metaData)
+{
+    if (m_avTransport.isNull()) {
+        return;
+    }
+
+    queueCall(m_avTransport->call(QLatin1String("SetNextAVTransportURI"),
+                                  QLatin1String("InstanceID"), QLatin1String("0"),
+                                  QLatin1String("NextURI"), uri,
+                                  QLatin1String("NextURIMetaData"), metaData),
+              SLOT(onSetNextAVTransportUri()));
+}
+
+/*!
+ * \brief Play the items of a BrowseModel from row on, one after the other.
+ */
+void UPnPRenderer::playFrom(QObject *model, int row)
+{
+    if (m_avTransport.isNull()) {
+        return;
+    }
+
+    m_queue->playFrom(qobject_cast<BrowseModel *>(model), row);
+}
+
+/*!
+ * \brief Play all items of a container and the containers below it.
+ *
+ * \param server the UPnPMediaServer the container is on
+ * \param id ObjectID of the container
+ */
+void UPnPRenderer::playContainer(QObject *server, const QString &id)
+{
+    auto mediaServer = qobject_cast<UPnPMediaServer *>(server);
+
+    if (m_avTransport.isNull() || mediaServer == 0) {
+        return;
+    }
+
+    m_queue->playCrawl(mediaServer->crawl(id));
+}
+
+void UPnPRenderer::onSetNextAVTransportUri()
+{
+    auto call = qobject_cast<ServiceProxyCall *>(sender());
+
+    if (call == 0) {
+        return;
+    }
+
+    unqueueCall(call);
+
+    if (not call->hasError()) {
+        return;
+    }
+
+    // Otherwise the queue starts the next item once the renderer stopped
+    qDebug() << "SetNextAVTransportURI failed:" << call->errorMessage();
+    if (call->errorCode() == 602 || call->errorCode() == 401) {
+        qDebug() << "Device does not implement SetNextAVTransportURI";
+        m_queue->setGapless(false);
+    }
+}
+
 void UPnPRenderer::onPause ()
 {
     ServiceProxyCall *call = qobject_cast<ServiceProxyCall *>(sender());
@@ -587,6 +825,8 @@ void UPnPRenderer::play()
         return;
     }
 
+    m_queue->setAdvancing(true);
+
     queueCall(m_avTransport->call(QLatin1String("Play"),
                                   QLatin1String("InstanceID"), QLatin1String("0"),
                                   QLatin1String("Speed"), QLatin1String("1")));
@@ -594,6 +834,7 @@ void UPnPRenderer::play()
 
 void UPnPRenderer::stop()
 {
+    m_queue->setAdvancing(false);
     stop(0);
 }
 
@@ -622,7 +863,7 @@ void UPnPRenderer::pause()
 
 void UPnPRenderer::prev()
 {
-    if (m_avTransport.isNull()) {
+    if (m_avTransport.isNull() || m_queue->previous()) {
         return;
     }
 
@@ -632,7 +873,7 @@ void UPnPRenderer::prev()
 
 void UPnPRenderer::next()
 {
-    if (m_avTransport.isNull()) {
+    if (m_avTransport.isNull() || m_queue->next()) {
         return;
     }
 
@@ -648,10 +889,8 @@ void UPnPRenderer::seekRelative(float percent)
     
     QString target = getRelativeTime(percent);
 
-    queueCall(m_avTransport->call(QLatin1String("Seek"),
-                                  QLatin1String("InstanceID"), QLatin1String("0"),
-                                  QLatin1String("Unit"), m_seekMode,
-                                  QLatin1String("Target"), target));
+    m_clock.seek(parseDurationString(target) * 1000);
+    sendCommand(CommandSeek, target);
 }
 
 QString UPnPRenderer::getRelativeTime(float percent)
@@ -662,16 +901,7 @@ QString UPnPRenderer::getRelativeTime(float percent)
         percent = 1.0;
     }
 
-    quint64 position = percent * m_durationInSeconds;
-
-    int hours = position / 3600;
-    position %= 3600;
-    int minutes = position / 60;
-    int seconds = position % 60;
-
-    return QString::fromLatin1("%1:%2:%3").arg(hours)
-                                          .arg(minutes, 2, 10, QLatin1Char('0'))
-                                          .arg(seconds, 2, 10, QLatin1Char('0'));
+    return formatPosition(percent * m_durationInSeconds);
 }
 
 void UPnPRenderer::setRemoteMute(bool mute)
@@ -681,10 +911,7 @@ void UPnPRenderer::setRemoteMute(bool mute)
     }
 
     m_mute = mute;
-    queueCall(m_renderingControl->call(QLatin1String("SetMute"),
-                                       QLatin1String("InstanceID"), QLatin1String("0"),
-                                       QLatin1String("Channel"), QLatin1String("Master"),
-                                       QLatin1String("DesiredMute"), mute));
+    sendCommand(CommandMute, mute);
 }
 
 void UPnPRenderer::setRemoteVolume(unsigned int volume)
@@ -694,8 +921,206 @@ void UPnPRenderer::setRemoteVolume(unsigned int volume)
     }
 
     m_volume = volume;
-    queueCall(m_renderingControl->call(QLatin1String("SetVolume"),
-                                       QLatin1String("InstanceID"), QLatin1String("0"),
-                                       QLatin1String("Channel"), QLatin1String("Master"),
-                                       QLatin1String("DesiredVolume"), volume));
+    sendCommand(CommandVolume, volume);
+}
+
+/*!
+ * \brief Send a command, or replace the one waiting if one is running.
+ *
+ * However fast the user drags a slider, the renderer gets at most one
+ * call per command at a time and the last value is applied one round
+ * trip after the previous call returned.
+ */
+void UPnPRenderer::sendCommand(Command command, const QVariant &value)
+{
+    if (m_commands[command] != 0) {
+        m_queuedCommands[command] = value;
+
+        return;
+    }
+
+    m_heldChanges[command] = QVariant();
+    startCommand(command, value);
+}
+
+void UPnPRenderer::startCommand(Command command, const QVariant &value)
+{
+    ServiceProxyCall *call = 0;
+
+    switch (command) {
+    case CommandVolume:
+        call = m_renderingControl->call(QLatin1String("SetVolume"),
+                                        QLatin1String("InstanceID"), QLatin1String("0"),
+                                        QLatin1String("Channel"), QLatin1String("Master"),
+                                        QLatin1String("DesiredVolume"), value);
+        break;
+    case CommandMute:
+        call = m_renderingControl->call(QLatin1String("SetMute"),
+                                        QLatin1String("InstanceID"), QLatin1String("0"),
+                                        QLatin1String("Channel"), QLatin1String("Master"),
+                                        QLatin1String("DesiredMute"), value);
+        break;
+    case CommandSeek:
+        call = m_avTransport->call(QLatin1String("Seek"),
+                                   QLatin1String("InstanceID"), QLatin1String("0"),
+                                   QLatin1String("Unit"), m_seekMode,
+                                   QLatin1String("Target"), value);
+        break;
+    default:
+        return;
+    }
+
+    m_commands[command] = call;
+    queueCall(call, SLOT(onCommandReady()));
+}
+
+/*!
+ * \brief A command is busy while its call runs or a newer value waits.
+ */
+bool UPnPRenderer::commandBusy(Command command) const
+{
+    return m_commands[command] != 0 || m_queuedCommands[command].isValid();
+}
+
+/*!
+ * \brief Start the newest value of the command, or reconcile with the
+ *        renderer if there is none.
+ */
+void UPnPRenderer::onCommandReady()
+{
+    auto call = qobject_cast<ServiceProxyCall *>(sender());
+
+    if (call == 0) {
+        return;
+    }
+
+    unqueueCall(call);
+
+    int command = 0;
+    while (command < COMMAND_COUNT && m_commands[command] != call) {
+        command++;
+    }
+
+    // A call to a device wrapped before
+    if (command == COMMAND_COUNT) {
+        return;
+    }
+
+    m_commands[command] = 0;
+    if (call->hasError()) {
+        Q_EMIT error(call->errorCode(), call->errorMessage());
+    }
+
+    if (m_queuedCommands[command].isValid()) {
+        const QVariant value = m_queuedCommands[command];
+
+        m_queuedCommands[command] = QVariant();
+        startCommand(Command(command), value);
+
+        return;
+    }
+
+    // Whatever LastChange reports from now on is current. If the last call
+    // failed, the renderer did not take the value; fall back to what it
+    // reported meanwhile or ask it.
+    const QVariant held = m_heldChanges[command];
+    m_heldChanges[command] = QVariant();
+
+    switch (command) {
+    case CommandVolume:
+        if (call->hasError() && held.isValid()) {
+            setVolume(held.toUInt());
+        } else if (call->hasError()) {
+            queryCommand(CommandVolume);
+        }
+        break;
+    case CommandMute:
+        if (call->hasError() && held.isValid()) {
+            setMute(held.toBool());
+        } else if (call->hasError()) {
+            queryCommand(CommandMute);
+        }
+        break;
+    case CommandSeek:
+        m_clock.resync();
+        break;
+    }
+}
+
+/*!
+ * \brief Ask the renderer for the value of a command it rejected.
+ *
+ * The query counts as running command, so values the user sets meanwhile
+ * wait for it and LastChange values are held.
+ */
+void UPnPRenderer::queryCommand(Command command)
+{
+    ServiceProxyCall *call = 0;
+
+    switch (command) {
+    case CommandVolume:
+        call = m_renderingControl->call(QLatin1String("GetVolume"),
+                                        QLatin1String("InstanceID"), QLatin1String("0"),
+                                        QLatin1String("Channel"), QLatin1String("Master"));
+        break;
+    case CommandMute:
+        call = m_renderingControl->call(QLatin1String("GetMute"),
+                                        QLatin1String("InstanceID"), QLatin1String("0"),
+                                        QLatin1String("Channel"), QLatin1String("Master"));
+        break;
+    default:
+        return;
+    }
+
+    m_commands[command] = call;
+    queueCall(call, SLOT(onQueryReady()));
+}
+
+void UPnPRenderer::onQueryReady()
+{
+    auto call = qobject_cast<ServiceProxyCall *>(sender());
+
+    if (call == 0) {
+        return;
+    }
+
+    int command = 0;
+    while (command < COMMAND_COUNT && m_commands[command] != call) {
+        command++;
+    }
+
+    // A call to a device wrapped before
+    if (command == COMMAND_COUNT) {
+        unqueueCall(call);
+
+        return;
+    }
+
+    const QString name = command == CommandVolume ? QLatin1String("CurrentVolume")
+                                                  : QLatin1String("CurrentMute");
+    unqueueCall(call, QStringList() << name);
+    m_commands[command] = 0;
+
+    const QVariant held = m_heldChanges[command];
+    m_heldChanges[command] = QVariant();
+
+    if (m_queuedCommands[command].isValid()) {
+        const QVariant value = m_queuedCommands[command];
+
+        m_queuedCommands[command] = QVariant();
+        startCommand(Command(command), value);
+
+        return;
+    }
+
+    const QVariant value = call->hasError() ? held : call->get(name);
+    if (not value.isValid()) {
+        return;
+    }
+
+    if (command == CommandVolume) {
+        setVolume(value.toUInt());
+    } else {
+        setMute(value.toBool());
+    }
 }
@@ -21,15 +21,18 @@ along with Helium.  If not, see <http://www.gnu.org/licenses/>.
 #define UPNPRENDERER_H
 
 #include <QObject>
-#include <QTimer>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QList>
 
 #include <libgupnp-av/gupnp-av.h>
 
+#include "lastchangestreamparser.h"
+#include "playbackclock.h"
 #include "serviceproxy.h"
 #include "upnpdevice.h"
 #include "refptrg.h"
 
+class PlaybackQueue;
 class UPnPRenderer : public UPnPDevice
 {
     Q_OBJECT
@@ -48,6 +51,7 @@ class UPnPRenderer : public UPnPDevice
     Q_PROPERTY(bool mute READ mute WRITE setRemoteMute NOTIFY muteChanged)
     Q_PROPERTY(unsigned int volume READ volume WRITE setRemoteVolume NOTIFY volumeChanged)
     Q_PROPERTY(unsigned int maxVolume READ maxVolume NOTIFY maxVolumeChanged)
+    Q_PROPERTY(int readyTime READ readyTime NOTIFY readyTimeChanged)
 public:
     static const char DEVICE_TYPE[];
     static const char AV_TRANSPORT_SERVICE[];
@@ -63,6 +67,7 @@ public:
     float progress() { return m_progress; }
     QString title() { return m_currentTitle; }
     QString position() { return m_position; }
+    QString trackUri() const { return m_trackUri; }
     bool canPause() const { return m_canPause; }
     bool canSeek() const { return m_canSeek; }
     QString seekMode() { return m_seekMode; }
@@ -76,6 +81,9 @@ public:
     unsigned int maxVolume() const { return m_maxVolume; }
     void setRemoteVolume(unsigned int volume);
 
+    // milliseconds from wrapDevice() until ready(), -1 until then
+    int readyTime() const { return m_readyTime; }
+
     // QML invokable functions
     Q_INVOKABLE virtual void wrapDevice(const QString &udn);
 
@@ -93,6 +101,13 @@ public:
     Q_INVOKABLE void next();
     Q_INVOKABLE void prev();
 
+    // AVTransport:2 optional
+    Q_INVOKABLE void setNextAVTransportUri(const QString& uri, const QString& metaData = QLatin1String(""));
+
+    // Playback queue
+    Q_INVOKABLE void playFrom(QObject *model, int row);
+    Q_INVOKABLE void playContainer(QObject *server, const QString &id);
+
 Q_SIGNALS:
 
     // Property notifiers
@@ -111,18 +126,40 @@ Q_SIGNALS:
     void canVolumeChanged(void);
     void volumeChanged(void);
     void maxVolumeChanged(void);
+    void trackUriChanged(void);
+    void readyTimeChanged(void);
 
 private Q_SLOTS:
-    void onProgressTimeout();
+    void onClockTick();
+    void onResyncRequested();
     void onLastChange(const QString &name, const QVariant &value);
     void onRenderingControlIntrospectionReady();
     void onAVTransportIntrospectionReady();
     void onGetPositionInfoReady();
     void onPause();
+    void onSetNextAVTransportUri();
+    void onCommandReady();
+    void onQueryReady();
     void onSetAVTransportUri();
+    void onPlayQueued();
     void onGetProtocolInfo();
 
 private:
+    // Commands the user can repeat faster than the renderer answers
+    enum Command {
+        CommandVolume,
+        CommandMute,
+        CommandSeek,
+        COMMAND_COUNT
+    };
+
+    // What wrapDevice() waits for before emitting ready()
+    enum BringUpStep {
+        StepProtocolInfo = 0x01,
+        StepAVTransport = 0x02,
+        StepRenderingControl = 0x04
+    };
+
     // private property setters
     void setState(const QString &state);
     void setDuration(const QString &duration);
@@ -131,6 +168,7 @@ private:
     void setTitle(const QString &uri);
     void setCanPause(bool canPause);
     void setPosition(const QString &position);
+    void setTrackUri(const QString &uri);
     void setCanSeek(bool canSeek);
     void setSeekMode(const QString &seekMode);
     void setCanMute(bool canMute);
@@ -138,26 +176,52 @@ private:
     void setMaxVolume(unsigned int maxVolume);
     void setMute(bool mute);
     void setVolume(unsigned int volume);
+    void setReadyTime(int readyTime);
 
     void stop(ServiceProxyCall *next);
     void setAVTransportUri(const QString &uri, const QString &metaData, ServiceProxyCall *next);
+    void playQueued(const QString &uri, const QString &metaData);
+
+    void sendCommand(Command command, const QVariant &value);
+    void startCommand(Command command, const QVariant &value);
+    bool commandBusy(Command command) const;
+    void queryCommand(Command command);
 
+    void bringUpDone(BringUpStep step);
     void unsubscribe();
+    void applyLastChange(const LastChangeSet &change);
 
-    RefPtrG<GUPnPLastChangeParser> m_lastChangeParser;
+    LastChangeStreamParser m_lastChangeParser;
+    // metadata the title was last taken from
+    QByteArray m_metaData;
     QScopedPointer<ServiceProxy> m_avTransport;
     QScopedPointer<ServiceProxy> m_connectionManager;
     QScopedPointer<ServiceProxy> m_renderingControl;
+    // BringUpSteps that did not finish yet
+    int m_pendingSteps;
+    ServiceProxyCall *m_protocolInfoCall;
+    QElapsedTimer m_bringUpTimer;
+    int m_readyTime;
     QString m_state;
     QString m_protocolInfo;
     QString m_duration;
-    QTimer m_progressTimer;
+    PlaybackClock m_clock;
+    // running GetPositionInfo, 0 if none
+    ServiceProxyCall *m_positionCall;
     quint64 m_durationInSeconds;
-    quint64 m_currentPosition;
     float m_progress;
     bool m_canPause;
     QString m_currentTitle;
     QString m_position;
+    QString m_trackUri;
+    PlaybackQueue *m_queue;
+    // Play call of the last item started by the queue, 0 once it is sent
+    ServiceProxyCall *m_queuedPlay;
+    // At most one call per Command is running; only the newest value waits
+    ServiceProxyCall *m_commands[COMMAND_COUNT];
+    QVariant m_queuedCommands[COMMAND_COUNT];
+    // LastChange values that arrived while the command was busy
+    QVariant m_heldChanges[COMMAND_COUNT];
     bool m_canSeek;
     QString m_seekMode;
     bool m_canVolume;
@@ -165,6 +229,8 @@ private:
     unsigned int m_maxVolume;
     bool m_canMute;
     bool m_mute;
+
+    friend class PlaybackQueue;
 };
 
 #endif // UPNPRENDERER_H